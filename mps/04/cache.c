@@ -0,0 +1,479 @@
+/*
+ * cache.c - Set associative cache model with pluggable replacement
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+
+// SRRIP/BRRIP: 2-bit RRPVs
+#define RRPV_MAX 3
+
+// BRRIP fills at RRPV_MAX - 1 once every this many fills
+#define BRRIP_THROTTLE 32
+
+static const char* policy_names[] = {
+    [REPL_LRU] = "lru",
+    [REPL_FIFO] = "fifo",
+    [REPL_RANDOM] = "random",
+    [REPL_PLRU] = "plru",
+    [REPL_SRRIP] = "srrip",
+    [REPL_BRRIP] = "brrip",
+};
+
+int repl_policy_parse(const char* name)
+{
+    for (unsigned i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++)
+        if (strcmp(name, policy_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+int cache_init(struct cache_t* cache, unsigned setbits, unsigned lines_per_set,
+               unsigned offsetbits, enum repl_policy_t policy)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->nsets = 1ULL << setbits;
+    cache->lines_per_set = lines_per_set;
+    cache->block_size = 1ULL << offsetbits;
+    cache->setbits = setbits;
+    cache->offsetbits = offsetbits;
+    cache->policy = policy;
+    cache->rng = 0x2545f4914f6cdd1dULL;
+
+    if (policy == REPL_PLRU) {
+        if (lines_per_set > 64 || (lines_per_set & (lines_per_set - 1))) {
+            fprintf(stderr, "plru needs -E to be a power of 2 up to 64\n");
+            return -1;
+        }
+        cache->plru = (uint64_t*) calloc(cache->nsets, sizeof(uint64_t));
+        if (!cache->plru)
+            return -1;
+    }
+
+    // all lines start out invalid
+    cache->blocks = (struct cache_block_t*) calloc(cache->nsets * lines_per_set,
+                                                   sizeof(struct cache_block_t));
+    if (!cache->blocks) {
+        fprintf(stderr, "could not allocate cache\n");
+        return -1;
+    }
+    return 0;
+}
+
+void cache_free(struct cache_t* cache)
+{
+    free(cache->blocks);
+    free(cache->plru);
+}
+
+/*
+ * Tree PLRU keeps E - 1 bits per set, node n has children 2n and 2n+1
+ * and the ways are the leaves. A bit of 0 means the victim is on the
+ * left, so touching a way points every node on its path away from it.
+ */
+static void plru_touch(struct cache_t* cache, uint64_t set, int way)
+{
+    uint64_t bits = cache->plru[set];
+    unsigned node = 1;
+
+    for (unsigned half = cache->lines_per_set >> 1; half; half >>= 1) {
+        if (way & half) {
+            bits &= ~(1ULL << node);
+            node = 2 * node + 1;
+        } else {
+            bits |= 1ULL << node;
+            node = 2 * node;
+        }
+    }
+    cache->plru[set] = bits;
+}
+
+static int plru_victim(struct cache_t* cache, uint64_t set)
+{
+    uint64_t bits = cache->plru[set];
+    unsigned node = 1;
+    int way = 0;
+
+    for (unsigned half = cache->lines_per_set >> 1; half; half >>= 1) {
+        if (bits & (1ULL << node)) {
+            way |= half;
+            node = 2 * node + 1;
+        } else {
+            node = 2 * node;
+        }
+    }
+    return way;
+}
+
+// pick the line to evict from a full set
+static int find_victim(struct cache_t* cache, uint64_t set, struct cache_block_t* lines)
+{
+    int victim = 0;
+
+    switch (cache->policy) {
+        case REPL_LRU:
+        case REPL_FIFO:
+            for (int i = 1; i < cache->lines_per_set; i++)
+                if (lines[i].stamp < lines[victim].stamp)
+                    victim = i;
+            return victim;
+
+        case REPL_RANDOM:
+            cache->rng ^= cache->rng << 13;
+            cache->rng ^= cache->rng >> 7;
+            cache->rng ^= cache->rng << 17;
+            return cache->rng % cache->lines_per_set;
+
+        case REPL_PLRU:
+            return plru_victim(cache, set);
+
+        case REPL_SRRIP:
+        case REPL_BRRIP:
+            // age the whole set until something is predicted distant
+            for (;;) {
+                for (int i = 0; i < cache->lines_per_set; i++)
+                    if (lines[i].rrpv >= RRPV_MAX)
+                        return i;
+                for (int i = 0; i < cache->lines_per_set; i++)
+                    lines[i].rrpv++;
+            }
+    }
+    return victim;
+}
+
+// update replacement state for a hit or fill of line way
+static void touch_line(struct cache_t* cache, uint64_t set, int way, int fill)
+{
+    struct cache_block_t* b = &cache->blocks[set * cache->lines_per_set + way];
+
+    switch (cache->policy) {
+        case REPL_LRU:
+            b->stamp = cache->clock;
+            break;
+        case REPL_FIFO:
+            if (fill)
+                b->stamp = cache->clock;
+            break;
+        case REPL_RANDOM:
+            break;
+        case REPL_PLRU:
+            plru_touch(cache, set, way);
+            break;
+        case REPL_SRRIP:
+            b->rrpv = fill ? RRPV_MAX - 1 : 0;
+            break;
+        case REPL_BRRIP:
+            if (!fill)
+                b->rrpv = 0;
+            else
+                b->rrpv = cache->fills % BRRIP_THROTTLE ? RRPV_MAX : RRPV_MAX - 1;
+            break;
+    }
+}
+
+// find addr's line in its set, -1 if absent
+static int find_line(struct cache_t* cache, struct cache_block_t* lines, uint64_t tag)
+{
+    for (int i = 0; i < cache->lines_per_set; i++)
+        if (lines[i].valid && lines[i].tag == tag)
+            return i;
+    return -1;
+}
+
+// put tag in a free or victim line of set
+static int fill_line(struct cache_t* cache, uint64_t set, uint64_t tag, int dirty)
+{
+    struct cache_block_t* lines = &cache->blocks[set * cache->lines_per_set];
+    int way = -1;
+    int ret = 0;
+
+    // prefer an unoccupied line
+    for (int i = 0; i < cache->lines_per_set; i++) {
+        if (!lines[i].valid) {
+            way = i;
+            break;
+        }
+    }
+
+    if (way < 0) {
+        way = find_victim(cache, set, lines);
+        cache->evictions++;
+        cache->victim = (lines[way].tag << (cache->offsetbits + cache->setbits))
+            | set << cache->offsetbits;
+        ret |= CACHE_EVICT;
+        if (lines[way].dirty) {
+            cache->writebacks++;
+            ret |= CACHE_DIRTY;
+        }
+    }
+
+    lines[way].tag = tag;
+    lines[way].valid = 1;
+    lines[way].dirty = dirty;
+    lines[way].prefetched = 0;
+    cache->fills++;
+    touch_line(cache, set, way, 1);
+    return ret;
+}
+
+int cache_access(struct cache_t* cache, uint64_t addr, int write)
+{
+    const uint64_t set = (addr >> cache->offsetbits) & (cache->nsets - 1);
+    const uint64_t tag = addr >> (cache->offsetbits + cache->setbits);
+    struct cache_block_t* lines = &cache->blocks[set * cache->lines_per_set];
+    // write-through lines never hold data newer than the level below
+    const int dirty = write && !cache->write_through;
+
+    cache->clock++;
+    if (write)
+        cache->writes++;
+    else
+        cache->reads++;
+
+    // look for it
+    int way = find_line(cache, lines, tag);
+    if (way >= 0) {
+        const int first_use = lines[way].prefetched;
+        cache->hits++;
+        lines[way].dirty |= dirty;
+        lines[way].prefetched = 0;
+        touch_line(cache, set, way, 0);
+        return CACHE_HIT | (first_use ? CACHE_PREFETCHED : 0);
+    }
+
+    // not in cache
+    cache->misses++;
+    if (write && cache->no_write_allocate)
+        return 0;
+    return fill_line(cache, set, tag, dirty) | CACHE_FILL;
+}
+
+int cache_insert(struct cache_t* cache, uint64_t addr, int dirty)
+{
+    const uint64_t set = (addr >> cache->offsetbits) & (cache->nsets - 1);
+    const uint64_t tag = addr >> (cache->offsetbits + cache->setbits);
+    struct cache_block_t* lines = &cache->blocks[set * cache->lines_per_set];
+
+    cache->clock++;
+
+    int way = find_line(cache, lines, tag);
+    if (way >= 0) {
+        lines[way].dirty |= dirty;
+        touch_line(cache, set, way, 0);
+        return 0;
+    }
+    return fill_line(cache, set, tag, dirty);
+}
+
+int cache_prefetch(struct cache_t* cache, uint64_t addr)
+{
+    const uint64_t set = (addr >> cache->offsetbits) & (cache->nsets - 1);
+    const uint64_t tag = addr >> (cache->offsetbits + cache->setbits);
+    struct cache_block_t* lines = &cache->blocks[set * cache->lines_per_set];
+
+    if (find_line(cache, lines, tag) >= 0)
+        return CACHE_HIT;
+
+    cache->clock++;
+    int ret = fill_line(cache, set, tag, 0);
+    lines[find_line(cache, lines, tag)].prefetched = 1;
+    return ret | CACHE_FILL;
+}
+
+int cache_probe(struct cache_t* cache, uint64_t addr)
+{
+    const uint64_t set = (addr >> cache->offsetbits) & (cache->nsets - 1);
+    const uint64_t tag = addr >> (cache->offsetbits + cache->setbits);
+
+    return find_line(cache, &cache->blocks[set * cache->lines_per_set], tag) >= 0;
+}
+
+int cache_invalidate(struct cache_t* cache, uint64_t addr)
+{
+    const uint64_t set = (addr >> cache->offsetbits) & (cache->nsets - 1);
+    const uint64_t tag = addr >> (cache->offsetbits + cache->setbits);
+    struct cache_block_t* lines = &cache->blocks[set * cache->lines_per_set];
+
+    int way = find_line(cache, lines, tag);
+    if (way < 0)
+        return 0;
+    lines[way].valid = 0;
+    return CACHE_HIT | (lines[way].dirty ? CACHE_DIRTY : 0);
+}
+
+/*
+ * Hierarchy
+ */
+
+static const char* incl_names[] = {
+    [INCL_NINE] = "nine",
+    [INCL_INCLUSIVE] = "inclusive",
+    [INCL_EXCLUSIVE] = "exclusive",
+};
+
+int incl_policy_parse(const char* name)
+{
+    for (unsigned i = 0; i < sizeof(incl_names) / sizeof(incl_names[0]); i++)
+        if (strcmp(name, incl_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+int write_policy_parse(struct cache_t* cache, const char* name)
+{
+    if (strcmp(name, "wb") == 0)
+        cache->write_through = 0;
+    else if (strcmp(name, "wt") == 0)
+        cache->write_through = 1;
+    else if (strcmp(name, "wa") == 0)
+        cache->no_write_allocate = 0;
+    else if (strcmp(name, "nwa") == 0)
+        cache->no_write_allocate = 1;
+    else
+        return -1;
+    return 0;
+}
+
+void hier_free(struct hier_t* hier)
+{
+    for (int i = 0; i < hier->nlevels; i++)
+        cache_free(&hier->levels[i]);
+}
+
+/*
+ * hier_evicted - level i gave up the line at victim; keep inclusion
+ *     above it and hand the line (or just its dirty data) down
+ */
+static void hier_evicted(struct hier_t* hier, int i, uint64_t victim, int dirty)
+{
+    if (i > 0 && hier->incl[i] == INCL_INCLUSIVE) {
+        for (int j = 0; j < i; j++) {
+            int r = cache_invalidate(&hier->levels[j], victim);
+            if (r)
+                hier->back_invalidations[i]++;
+            if (r & CACHE_DIRTY)
+                dirty = 1;
+        }
+    }
+
+    const int next = i + 1;
+    if (next == hier->nlevels) {
+        if (dirty)
+            hier->mem_writes++;
+        return;
+    }
+
+    // exclusive levels take every victim, others only dirty data
+    if (hier->incl[next] != INCL_EXCLUSIVE && !dirty)
+        return;
+
+    struct cache_t* c = &hier->levels[next];
+    int r = cache_insert(c, victim, dirty);
+    if (r & CACHE_EVICT)
+        hier_evicted(hier, next, c->victim, r & CACHE_DIRTY);
+}
+
+static int hier_level_access(struct hier_t* hier, int i, uint64_t addr, int write);
+
+/*
+ * hier_next - send a miss (write = 0) or a write that goes past level i
+ *     (write = 1) to the level below it. Returns nonzero if a fetched
+ *     line arrives dirty, out of an exclusive level.
+ */
+static int hier_next(struct hier_t* hier, int i, uint64_t addr, int write)
+{
+    const int next = i + 1;
+
+    if (next == hier->nlevels) {
+        if (write)
+            hier->mem_writes++;
+        else
+            hier->mem_reads++;
+        return 0;
+    }
+
+    if (hier->incl[next] != INCL_EXCLUSIVE) {
+        hier_level_access(hier, next, addr, write);
+        return 0;
+    }
+
+    // exclusive: a read hit moves the line up and out
+    struct cache_t* c = &hier->levels[next];
+    int r = cache_invalidate(c, addr);
+    if (!r) {
+        c->misses++;
+        return hier_next(hier, next, addr, write);
+    }
+    c->hits++;
+    if (!write)
+        return r & CACHE_DIRTY;
+
+    // a write that hits stays here, in the line it just left
+    cache_insert(c, addr, !c->write_through);
+    if (c->write_through) {
+        c->write_throughs++;
+        hier_next(hier, next, addr, 1);
+    }
+    return 0;
+}
+
+/*
+ * hier_level_access - access addr at non-exclusive level i, fetching it
+ *     from below on an allocating miss and forwarding writes that this
+ *     level does not absorb
+ */
+static int hier_level_access(struct hier_t* hier, int i, uint64_t addr, int write)
+{
+    struct cache_t* c = &hier->levels[i];
+    int r = cache_access(c, addr, write);
+    const uint64_t victim = c->victim;
+
+    if ((r & CACHE_FILL) && hier_next(hier, i, addr, 0))
+        cache_insert(c, addr, 1);
+    if (r & CACHE_EVICT)
+        hier_evicted(hier, i, victim, r & CACHE_DIRTY);
+    if (write && (c->write_through || !(r & (CACHE_HIT | CACHE_FILL)))) {
+        c->write_throughs++;
+        hier_next(hier, i, addr, 1);
+    }
+    return r;
+}
+
+int hier_access(struct hier_t* hier, uint64_t addr, int write)
+{
+    return hier_level_access(hier, 0, addr, write);
+}
+
+int hier_prefetch(struct hier_t* hier, uint64_t addr)
+{
+    struct cache_t* c = &hier->levels[0];
+    int r = cache_prefetch(c, addr);
+    const uint64_t victim = c->victim;
+
+    if (r & CACHE_HIT)
+        return r;
+    if (hier_next(hier, 0, addr, 0))
+        cache_insert(c, addr, 1);
+    if (r & CACHE_EVICT)
+        hier_evicted(hier, 0, victim, r & CACHE_DIRTY);
+    return r;
+}
+
+void hier_print(struct hier_t* hier, FILE* out)
+{
+    for (int i = 0; i < hier->nlevels; i++) {
+        struct cache_t* c = &hier->levels[i];
+        fprintf(out, "L%d: hits:%" PRIu64 " misses:%" PRIu64 " evictions:%" PRIu64
+                " writebacks:%" PRIu64, i + 1, c->hits, c->misses, c->evictions,
+                c->writebacks);
+        if (c->write_through || c->no_write_allocate)
+            fprintf(out, " write-throughs:%" PRIu64, c->write_throughs);
+        if (hier->incl[i] == INCL_INCLUSIVE)
+            fprintf(out, " back-invalidations:%" PRIu64, hier->back_invalidations[i]);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "memory: reads:%" PRIu64 " writes:%" PRIu64 "\n",
+            hier->mem_reads, hier->mem_writes);
+}
@@ -0,0 +1,168 @@
+/*
+ * cache.h - Set associative cache model used by csim
+ */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+// replacement policies, selected with csim -r
+enum repl_policy_t {
+    REPL_LRU,    // true least recently used
+    REPL_FIFO,   // oldest fill
+    REPL_RANDOM, // uniformly random way
+    REPL_PLRU,   // tree pseudo-LRU, E must be a power of 2 up to 64
+    REPL_SRRIP,  // static re-reference interval prediction, 2-bit RRPV
+    REPL_BRRIP,  // bimodal RRIP, fills mostly at distant re-reference
+};
+
+// one line of the cache
+struct cache_block_t
+{
+    int valid;
+    int dirty;
+    uint64_t tag;
+    uint64_t stamp; // LRU: last use, FIFO: fill time
+    uint8_t rrpv;   // SRRIP/BRRIP re-reference prediction value
+    uint8_t prefetched; // filled by cache_prefetch and not yet accessed
+};
+
+struct cache_t {
+    uint64_t nsets;
+    uint16_t lines_per_set;
+    uint64_t block_size; // in bytes
+    unsigned setbits;
+    unsigned offsetbits;
+    enum repl_policy_t policy;
+    int write_through;     // writes go straight on to the level below
+    int no_write_allocate; // write misses do not fill a line
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t writebacks; // dirty lines evicted
+    uint64_t write_throughs; // writes passed on to the level below
+    uint64_t reads;
+    uint64_t writes;
+
+    uint64_t clock;      // accesses so far, for stamps
+    uint64_t rng;        // xorshift state for REPL_RANDOM
+    uint64_t fills;      // fills so far, for BRRIP's bimodal throttle
+    uint64_t* plru;      // per set tree bits for REPL_PLRU
+    uint64_t victim;     // block address of the last line evicted
+
+    struct cache_block_t* blocks;
+};
+
+// cache_access result flags
+#define CACHE_HIT   0x1
+#define CACHE_EVICT 0x2
+#define CACHE_DIRTY 0x4 // the evicted (or invalidated) line was dirty
+#define CACHE_FILL  0x8 // a miss allocated a line
+#define CACHE_PREFETCHED 0x10 // the hit was the first use of a prefetched line
+// 0x20 and up are left to results built on these, such as coherence.h's
+
+/*
+ * cache_init - set up an empty cache with 2^setbits sets of lines_per_set
+ *     lines of 2^offsetbits bytes. Returns 0, or -1 with a message on
+ *     stderr if the geometry does not work with the policy.
+ */
+int cache_init(struct cache_t* cache, unsigned setbits, unsigned lines_per_set,
+               unsigned offsetbits, enum repl_policy_t policy);
+
+// free what cache_init allocated
+void cache_free(struct cache_t* cache);
+
+/*
+ * cache_access - look up addr, filling it on a miss and evicting a line
+ *     chosen by the policy if its set is full. A write leaves the line
+ *     dirty unless the cache is write-through, and a write miss fills
+ *     nothing if it is no-write-allocate. Returns CACHE_HIT, or
+ *     CACHE_FILL and maybe CACHE_EVICT, plus CACHE_DIRTY if the victim
+ *     (whose address is left in cache->victim) was dirty.
+ */
+int cache_access(struct cache_t* cache, uint64_t addr, int write);
+
+/*
+ * cache_insert - place addr in the cache without counting a hit or miss,
+ *     as when a line is handed down from the level above. Returns like
+ *     cache_access.
+ */
+int cache_insert(struct cache_t* cache, uint64_t addr, int dirty);
+
+/*
+ * cache_prefetch - fill addr as a prefetch: no hit or miss is counted and
+ *     the line is marked so the first access to it returns
+ *     CACHE_PREFETCHED too. Returns CACHE_HIT if addr was already cached,
+ *     else as cache_access.
+ */
+int cache_prefetch(struct cache_t* cache, uint64_t addr);
+
+// 1 if addr is cached, without touching replacement state
+int cache_probe(struct cache_t* cache, uint64_t addr);
+
+/*
+ * cache_invalidate - drop addr if present. Returns 0 if it was not
+ *     cached, else CACHE_HIT plus CACHE_DIRTY if it was dirty.
+ */
+int cache_invalidate(struct cache_t* cache, uint64_t addr);
+
+// parse a policy name as given to csim -r, -1 if unknown
+int repl_policy_parse(const char* name);
+
+/*
+ * Multi-level hierarchy. Level 0 is L1; each lower level states how it
+ * relates to the levels above it:
+ *   NINE       neither inclusive nor exclusive, filled on misses
+ *   inclusive  as NINE, and evicting a line invalidates it above
+ *   exclusive  only holds lines evicted from above, a hit moves the
+ *              line up and out of this level
+ * Dirty lines are written back one level down when evicted, and writes
+ * a write-through or no-write-allocate level does not keep are passed
+ * on down, to memory below the last level.
+ */
+#define HIER_MAX_LEVELS 8
+
+enum incl_policy_t {
+    INCL_NINE,
+    INCL_INCLUSIVE,
+    INCL_EXCLUSIVE,
+};
+
+struct hier_t {
+    int nlevels;
+    struct cache_t levels[HIER_MAX_LEVELS];
+    enum incl_policy_t incl[HIER_MAX_LEVELS];
+    uint64_t back_invalidations[HIER_MAX_LEVELS]; // caused by level i
+    uint64_t mem_reads;  // fetches that missed every level
+    uint64_t mem_writes; // writebacks from the last level
+};
+
+/*
+ * hier_access - access addr through the hierarchy, starting at L1.
+ *     Returns the L1 result as cache_access does.
+ */
+int hier_access(struct hier_t* hier, uint64_t addr, int write);
+
+/*
+ * hier_prefetch - prefetch addr into L1, fetching it from below like a
+ *     read miss would. Returns as cache_prefetch does.
+ */
+int hier_prefetch(struct hier_t* hier, uint64_t addr);
+
+// free every level
+void hier_free(struct hier_t* hier);
+
+// parse an inclusion policy name (nine, inclusive, exclusive), -1 if unknown
+int incl_policy_parse(const char* name);
+
+/*
+ * write_policy_parse - set cache's write policy from wb or wt (hit
+ *     policy) or wa or nwa (miss policy). Returns -1 if unknown.
+ */
+int write_policy_parse(struct cache_t* cache, const char* name);
+
+// print per level counters
+void hier_print(struct hier_t* hier, FILE* out);
+
+#endif
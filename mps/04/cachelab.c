@@ -126,6 +126,39 @@ static int internalAddressToArrayAccess(char *outputString, unsigned long long i
     return sprintf(outputString, "%llx", address);
 }
 
+int addressToArrayIndex(unsigned long long int address, int *row, int *col) {
+    if (transposeInfoStatus == 0) {
+        fprintf(stderr, "You must call initializeArrayAccessConverter with the input tracefile's name before using addressToArrayIndex!");
+        abort();
+    }
+    if (transposeInfoStatus < 0 || transposeInfo.N <= 0 || transposeInfo.M <= 0) {
+        return 0;
+    }
+    unsigned long long int totalSize = (unsigned long long int) transposeInfo.N * transposeInfo.M * sizeof(int);
+    if (address - transposeInfo.A < totalSize) {
+        unsigned long long int offset = (address - transposeInfo.A) / sizeof(int);
+        *row = (int)(offset / transposeInfo.M);
+        *col = (int)(offset % transposeInfo.M);
+        return 'A';
+    }
+    if (address - transposeInfo.B < totalSize) {
+        unsigned long long int offset = (address - transposeInfo.B) / sizeof(int);
+        *row = (int)(offset / transposeInfo.N);
+        *col = (int)(offset % transposeInfo.N);
+        return 'B';
+    }
+    return 0;
+}
+
+int arrayAccessDimensions(int *M, int *N) {
+    if (transposeInfoStatus <= 0) {
+        return 0;
+    }
+    *M = transposeInfo.M;
+    *N = transposeInfo.N;
+    return 1;
+}
+
 int addressToArrayAccess(char *outputString, unsigned long long int address) {
     if (transposeInfoStatus == 0) {
         fprintf(stderr, "You must call initializeArrayAccessConverter with the input tracefile's name before using addressToArrayAccess!");
@@ -16,6 +16,19 @@ typedef struct trans_func{
   unsigned int num_evictions;
 } trans_func_t;
 
+/*
+ * Shape of trans.c's parameterized transpose, searched over by transtune.
+ * A block covers bh rows and bw columns of A.
+ */
+struct trans_param {
+  int bh, bw;
+  int order; /* 0: blocks along the rows of A first, 1: down its columns */
+  int diag;  /* stage 0: write A's block diagonal last in each row */
+  int stage; /* 0: element by element, 1: each block row of up to 8
+                through registers, 2: 8x8 blocks by 4x4 quadrants,
+                3: trans.c's hand written transpose_submit instead */
+};
+
 /*
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
@@ -39,6 +52,20 @@ void initializeArrayAccessConverter(const char *tracefileName);
 int addressToArrayAccess(char *outputString, /* string to write into */
                          unsigned long long int address /* address to write */ );
 
+/**
+ * Like addressToArrayAccess, but gives the element's row and column
+ * Returns 'A' or 'B', or 0 if the address is in neither (or there is no .info file)
+ * @warning Requires you to run initializeArrayAccessConverter once first
+ */
+int addressToArrayIndex(unsigned long long int address, /* address to look up */
+                        int *row, int *col); /* where to store the element */
+
+/**
+ * Dimensions from the .info file: A is N rows of M, B is M rows of N
+ * Returns 0 if initializeArrayAccessConverter found no .info file
+ */
+int arrayAccessDimensions(int *M, int *N);
+
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
 
@@ -0,0 +1,183 @@
+/*
+ * classify.c - Compulsory/capacity/conflict (3C) miss classification
+ *
+ * A miss is compulsory if its line was never accessed before, capacity
+ * if a fully associative LRU cache of the same size misses as well, and
+ * conflict otherwise. The shadow cache sees every access that leaves the
+ * line in the real cache, hits included, so its LRU order is the real
+ * one. A no-write-allocate write miss only looks: the line is neither
+ * seen nor shadowed, as the real cache did not take it either.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "classify.h"
+
+#define NIL UINT32_MAX
+
+static uint64_t hash(uint64_t line)
+{
+    return (line * 0x9e3779b97f4a7c15ULL) >> 17;
+}
+
+int classify_init(struct classify_t* c, uint64_t lines, unsigned offsetbits)
+{
+    uint64_t buckets = 16;
+
+    memset(c, 0, sizeof(*c));
+    if (lines < 1 || lines >= NIL)
+        return -1;
+    while (buckets < 2 * lines)
+        buckets <<= 1;
+
+    c->offsetbits = offsetbits;
+    c->lines = lines;
+    c->head = c->tail = NIL;
+    c->tag = (uint64_t*) malloc(lines * sizeof(uint64_t));
+    c->prev = (uint32_t*) malloc(lines * sizeof(uint32_t));
+    c->next = (uint32_t*) malloc(lines * sizeof(uint32_t));
+    c->chain = (uint32_t*) malloc(lines * sizeof(uint32_t));
+    c->bucket = (uint32_t*) malloc(buckets * sizeof(uint32_t));
+    c->bucket_mask = buckets - 1;
+    c->seen_mask = 1023;
+    c->seen = (uint64_t*) calloc(c->seen_mask + 1, sizeof(uint64_t));
+    if (!c->tag || !c->prev || !c->next || !c->chain || !c->bucket || !c->seen) {
+        classify_free(c);
+        return -1;
+    }
+    memset(c->bucket, 0xff, buckets * sizeof(uint32_t));
+    return 0;
+}
+
+void classify_free(struct classify_t* c)
+{
+    free(c->tag);
+    free(c->prev);
+    free(c->next);
+    free(c->chain);
+    free(c->bucket);
+    free(c->seen);
+}
+
+/*
+ * seen_insert - look line up in the seen set, adding it if insert is
+ *     set. Returns 1 if it was new. The table doubles at half full.
+ */
+static int seen_insert(struct classify_t* c, uint64_t line, int insert)
+{
+    uint64_t h = hash(line) & c->seen_mask;
+
+    while (c->seen[h]) {
+        if (c->seen[h] == line + 1)
+            return 0;
+        h = (h + 1) & c->seen_mask;
+    }
+    if (!insert)
+        return 1;
+    c->seen[h] = line + 1;
+
+    if (++c->seen_count * 2 > c->seen_mask) {
+        uint64_t old_mask = c->seen_mask;
+        uint64_t* old = c->seen;
+        uint64_t* grown = (uint64_t*) calloc(2 * (old_mask + 1), sizeof(uint64_t));
+        if (!grown)
+            return 1; // keep probing the full table; it still works, slowly
+        c->seen = grown;
+        c->seen_mask = 2 * old_mask + 1;
+        for (uint64_t i = 0; i <= old_mask; i++) {
+            if (!old[i])
+                continue;
+            uint64_t k = hash(old[i] - 1) & c->seen_mask;
+            while (c->seen[k])
+                k = (k + 1) & c->seen_mask;
+            c->seen[k] = old[i];
+        }
+        free(old);
+    }
+    return 1;
+}
+
+static void list_unlink(struct classify_t* c, uint32_t s)
+{
+    if (c->prev[s] != NIL)
+        c->next[c->prev[s]] = c->next[s];
+    else
+        c->head = c->next[s];
+    if (c->next[s] != NIL)
+        c->prev[c->next[s]] = c->prev[s];
+    else
+        c->tail = c->prev[s];
+}
+
+static void list_push(struct classify_t* c, uint32_t s)
+{
+    c->prev[s] = NIL;
+    c->next[s] = c->head;
+    if (c->head != NIL)
+        c->prev[c->head] = s;
+    c->head = s;
+    if (c->tail == NIL)
+        c->tail = s;
+}
+
+/*
+ * shadow_access - access line in the shadow cache, filling it on a miss
+ *     if allocate is set. Returns 1 on a hit.
+ */
+static int shadow_access(struct classify_t* c, uint64_t line, int allocate)
+{
+    uint32_t* b = &c->bucket[hash(line) & c->bucket_mask];
+    uint32_t s;
+
+    for (s = *b; s != NIL; s = c->chain[s])
+        if (c->tag[s] == line) {
+            list_unlink(c, s);
+            list_push(c, s);
+            return 1;
+        }
+
+    if (!allocate)
+        return 0;
+    if (c->used < c->lines) {
+        s = c->used++;
+    } else {
+        // evict the least recently used line, unhooking it from its bucket
+        s = c->tail;
+        list_unlink(c, s);
+        uint32_t* p = &c->bucket[hash(c->tag[s]) & c->bucket_mask];
+        while (*p != s)
+            p = &c->chain[*p];
+        *p = c->chain[s];
+    }
+    c->tag[s] = line;
+    c->chain[s] = *b;
+    *b = s;
+    list_push(c, s);
+    return 0;
+}
+
+enum miss_class_t classify_access(struct classify_t* c, uint64_t addr, int missed,
+                                  int cached)
+{
+    const uint64_t line = addr >> c->offsetbits;
+    const int first = seen_insert(c, line, cached);
+    const int shadow_hit = shadow_access(c, line, cached);
+    enum miss_class_t cls;
+
+    if (!missed)
+        return MISS_NONE;
+    if (first)
+        cls = MISS_COMPULSORY;
+    else if (!shadow_hit)
+        cls = MISS_CAPACITY;
+    else
+        cls = MISS_CONFLICT;
+    c->counts[cls]++;
+    return cls;
+}
+
+const char* miss_class_name(enum miss_class_t cls)
+{
+    static const char* names[] = { "compulsory", "capacity", "conflict", "hit" };
+    return names[cls];
+}
@@ -0,0 +1,63 @@
+/*
+ * classify.h - Compulsory/capacity/conflict (3C) miss classification
+ */
+#ifndef CLASSIFY_H
+#define CLASSIFY_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+enum miss_class_t {
+    MISS_COMPULSORY, // first access to the line
+    MISS_CAPACITY,   // a fully associative LRU cache as big would miss too
+    MISS_CONFLICT,   // only missed for want of associativity
+    MISS_NONE,       // the real cache hit
+};
+
+#define MISS_CLASSES 3
+
+/*
+ * A fully associative LRU shadow cache with as many lines as the real
+ * one, kept as a list from most to least recently used plus a chained
+ * hash from line to list slot, and the set of every line seen so far.
+ */
+struct classify_t {
+    unsigned offsetbits;
+    uint32_t lines;     // shadow capacity
+    uint32_t used;
+    uint32_t head, tail;
+    uint64_t* tag;      // per slot: line number
+    uint32_t* prev;     // per slot: list links
+    uint32_t* next;
+    uint32_t* chain;    // per slot: next slot in the same hash bucket
+    uint32_t* bucket;   // first slot per bucket
+    uint64_t bucket_mask;
+
+    uint64_t* seen;     // open addressing, line + 1, 0 for empty
+    uint64_t seen_mask;
+    uint64_t seen_count;
+
+    uint64_t counts[MISS_CLASSES];
+};
+
+/*
+ * classify_init - shadow a cache of lines lines of 2^offsetbits bytes.
+ *     Returns 0, or -1 if out of memory.
+ */
+int classify_init(struct classify_t* c, uint64_t lines, unsigned offsetbits);
+
+void classify_free(struct classify_t* c);
+
+/*
+ * classify_access - pass addr through the shadow cache and seen set,
+ *     as the real cache just did: missed if it missed, cached if the line
+ *     is in it now (a hit or an allocating miss). If that missed, count
+ *     and return the miss's class, else MISS_NONE.
+ */
+enum miss_class_t classify_access(struct classify_t* c, uint64_t addr, int missed,
+                                  int cached);
+
+// name of a class, as printed
+const char* miss_class_name(enum miss_class_t cls);
+
+#endif
@@ -0,0 +1,278 @@
+/*
+ * coherence.c - Private L1s kept coherent by MESI over a snooping bus
+ *
+ * Every L1 miss goes on the bus. Another core's copy supplies the line if
+ * there is one (an M copy is flushed to the LLC on the way), otherwise the
+ * LLC or memory does. A coherence miss is a miss on a line the core lost
+ * to another core's write; it is false sharing if none of the bytes it
+ * accesses were written by another core since, so it would have hit had
+ * the data been laid out in separate lines.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "coherence.h"
+
+#define DIR_INITIAL 1024
+
+static uint64_t hash(uint64_t line)
+{
+    return (line * 0x9e3779b97f4a7c15ULL) >> 17;
+}
+
+int coherence_init(struct coherence_t* coh, int ncores, unsigned s, unsigned E,
+                   unsigned b, enum repl_policy_t policy, struct cache_t* llc)
+{
+    memset(coh, 0, sizeof(*coh));
+    if (ncores < 1 || ncores > COH_MAX_CORES) {
+        fprintf(stderr, "-c takes 1 to %d cores\n", COH_MAX_CORES);
+        return -1;
+    }
+    coh->ncores = ncores;
+    coh->offsetbits = b;
+    coh->granule_bits = b > 6 ? b - 6 : 0;
+    coh->llc = llc;
+
+    coh->mask = DIR_INITIAL - 1;
+    coh->lines = (struct coh_line*) calloc(DIR_INITIAL, sizeof(struct coh_line));
+    if (!coh->lines) {
+        fprintf(stderr, "could not allocate the directory\n");
+        return -1;
+    }
+    for (int i = 0; i < ncores; i++)
+        if (cache_init(&coh->cores[i].l1, s, E, b, policy) < 0) {
+            coh->ncores = i;
+            coherence_free(coh);
+            return -1;
+        }
+    return 0;
+}
+
+void coherence_free(struct coherence_t* coh)
+{
+    for (int i = 0; i < coh->ncores; i++)
+        cache_free(&coh->cores[i].l1);
+    free(coh->lines);
+}
+
+// double the directory, 0 if out of memory
+static int dir_grow(struct coherence_t* coh)
+{
+    const uint64_t mask = 2 * coh->mask + 1;
+    struct coh_line* lines = (struct coh_line*) calloc(mask + 1, sizeof(struct coh_line));
+
+    if (!lines)
+        return 0;
+    for (uint64_t i = 0; i <= coh->mask; i++) {
+        if (!coh->lines[i].line)
+            continue;
+        uint64_t h = hash(coh->lines[i].line - 1) & mask;
+        while (lines[h].line)
+            h = (h + 1) & mask;
+        lines[h] = coh->lines[i];
+    }
+    free(coh->lines);
+    coh->lines = lines;
+    coh->mask = mask;
+    return 1;
+}
+
+// directory entry for line, added if new
+static struct coh_line* dir_find(struct coherence_t* coh, uint64_t line)
+{
+    uint64_t h = hash(line) & coh->mask;
+
+    while (coh->lines[h].line) {
+        if (coh->lines[h].line == line + 1)
+            return &coh->lines[h];
+        h = (h + 1) & coh->mask;
+    }
+    if (2 * (coh->used + 1) > coh->mask && dir_grow(coh))
+        return dir_find(coh, line);
+
+    coh->used++;
+    coh->lines[h].line = line + 1;
+    return &coh->lines[h];
+}
+
+// granules of a line that size bytes at addr cover
+static uint64_t granules(struct coherence_t* coh, uint64_t addr, unsigned size)
+{
+    const uint64_t line_size = 1ULL << coh->offsetbits;
+    const uint64_t first = addr & (line_size - 1);
+    uint64_t last = first + (size ? size : 1) - 1;
+
+    if (last >= line_size)
+        last = line_size - 1;
+    const unsigned lo = first >> coh->granule_bits, hi = last >> coh->granule_bits;
+    return (hi == 63 ? ~0ULL : (1ULL << (hi + 1)) - 1) & ~((1ULL << lo) - 1);
+}
+
+// a dirty line leaves a core for the LLC or memory
+static void write_back(struct coherence_t* coh, uint64_t addr)
+{
+    coh->writebacks++;
+    if (!coh->llc) {
+        coh->mem_writes++;
+        return;
+    }
+    if ((cache_insert(coh->llc, addr, 1) & (CACHE_EVICT | CACHE_DIRTY))
+            == (CACHE_EVICT | CACHE_DIRTY))
+        coh->mem_writes++;
+}
+
+// a line no other core has comes from the LLC or memory
+static void fetch(struct coherence_t* coh, uint64_t addr)
+{
+    if (!coh->llc) {
+        coh->mem_reads++;
+        return;
+    }
+    int r = cache_access(coh->llc, addr, 0);
+    if (!(r & CACHE_HIT))
+        coh->mem_reads++;
+    if ((r & (CACHE_EVICT | CACHE_DIRTY)) == (CACHE_EVICT | CACHE_DIRTY))
+        coh->mem_writes++;
+}
+
+int coherence_access(struct coherence_t* coh, int core, uint64_t addr, unsigned size,
+                     int write)
+{
+    struct coh_core* me = &coh->cores[core];
+    const uint64_t line = addr >> coh->offsetbits;
+    const uint64_t touched = granules(coh, addr, size);
+    struct coh_line* d = dir_find(coh, line);
+    const int state = d->state[core];
+    int ret = 0;
+
+    if (state != MESI_I) {
+        me->hits++;
+        cache_access(&me->l1, addr, write); // replacement state only
+        ret = CACHE_HIT;
+        if (write && state == MESI_S) {
+            me->upgrades++;
+            coh->bus_upgrades++;
+            ret |= COH_UPGRADE;
+        }
+    } else {
+        me->misses++;
+        if (d->lost & (1u << core)) {
+            me->coherence_misses++;
+            ret |= COH_COHERENCE;
+            if (d->written[core] & touched) {
+                coh->true_sharing++;
+                d->true_misses++;
+            } else {
+                coh->false_sharing++;
+                d->false_misses++;
+                ret |= COH_FALSE;
+            }
+            d->lost &= ~(1u << core);
+        }
+
+        if (write)
+            coh->bus_readx++;
+        else
+            coh->bus_reads++;
+
+        // snoop: is the line anywhere else, and is it dirty?
+        int others = 0;
+        for (int i = 0; i < coh->ncores; i++) {
+            if (i == core || d->state[i] == MESI_I)
+                continue;
+            others++;
+            if (d->state[i] == MESI_M) {
+                write_back(coh, line << coh->offsetbits);
+                d->state[i] = MESI_S;
+            } else if (d->state[i] == MESI_E) {
+                d->state[i] = MESI_S;
+            }
+        }
+        if (others)
+            coh->transfers++;
+        else
+            fetch(coh, addr);
+
+        // fill, and give up whatever line that evicts
+        int r = cache_access(&me->l1, addr, write);
+        if (r & CACHE_EVICT) {
+            struct coh_line* v = dir_find(coh, me->l1.victim >> coh->offsetbits);
+            d = dir_find(coh, line); // may have moved if the directory grew
+            if (v->state[core] == MESI_M)
+                write_back(coh, me->l1.victim);
+            v->state[core] = MESI_I;
+        }
+        d->state[core] = others ? MESI_S : MESI_E;
+    }
+
+    if (write) {
+        // BusRdX and BusUpgr invalidate every other copy
+        if (d->state[core] != MESI_M)
+            for (int i = 0; i < coh->ncores; i++) {
+                if (i == core || d->state[i] == MESI_I)
+                    continue;
+                cache_invalidate(&coh->cores[i].l1, addr);
+                d->state[i] = MESI_I;
+                d->lost |= 1u << i;
+                d->written[i] = 0;
+                coh->invalidations++;
+            }
+        d->state[core] = MESI_M;
+
+        // what each core that lost the line would find changed
+        for (int i = 0; i < coh->ncores; i++)
+            if (d->lost & (1u << i))
+                d->written[i] |= touched;
+    }
+    return ret;
+}
+
+static int by_false_misses(const void* a, const void* b)
+{
+    const struct coh_line* x = *(const struct coh_line* const*) a;
+    const struct coh_line* y = *(const struct coh_line* const*) b;
+
+    if (x->false_misses != y->false_misses)
+        return x->false_misses < y->false_misses ? 1 : -1;
+    return x->line < y->line ? -1 : x->line > y->line;
+}
+
+void coherence_print(struct coherence_t* coh, FILE* out, int top)
+{
+    for (int i = 0; i < coh->ncores; i++) {
+        const struct coh_core* c = &coh->cores[i];
+        fprintf(out, "core %d: hits:%" PRIu64 " misses:%" PRIu64 " coherence misses:%"
+                PRIu64 " upgrades:%" PRIu64 "\n", i, c->hits, c->misses,
+                c->coherence_misses, c->upgrades);
+    }
+    fprintf(out, "bus: reads:%" PRIu64 " readx:%" PRIu64 " upgrades:%" PRIu64
+            " invalidations:%" PRIu64 " transfers:%" PRIu64 " writebacks:%" PRIu64 "\n",
+            coh->bus_reads, coh->bus_readx, coh->bus_upgrades, coh->invalidations,
+            coh->transfers, coh->writebacks);
+    if (coh->llc)
+        fprintf(out, "LLC: hits:%" PRIu64 " misses:%" PRIu64 " evictions:%" PRIu64 "\n",
+                coh->llc->hits, coh->llc->misses, coh->llc->evictions);
+    fprintf(out, "memory: reads:%" PRIu64 " writes:%" PRIu64 "\n",
+            coh->mem_reads, coh->mem_writes);
+
+    // lines with any false sharing, worst first
+    const struct coh_line** shared = NULL;
+    uint64_t n = 0;
+    for (uint64_t i = 0; i <= coh->mask; i++)
+        if (coh->lines[i].false_misses)
+            n++;
+    fprintf(out, "coherence misses: true sharing:%" PRIu64 " false sharing:%" PRIu64
+            " false sharing lines:%" PRIu64 "\n", coh->true_sharing, coh->false_sharing, n);
+    if (!n || top < 1 || !(shared = (const struct coh_line**) malloc(n * sizeof(*shared))))
+        return;
+    n = 0;
+    for (uint64_t i = 0; i <= coh->mask; i++)
+        if (coh->lines[i].false_misses)
+            shared[n++] = &coh->lines[i];
+    qsort(shared, n, sizeof(*shared), by_false_misses);
+    for (uint64_t i = 0; i < n && i < (uint64_t) top; i++)
+        fprintf(out, "  line %" PRIx64 ": false sharing:%" PRIu32 " true sharing:%" PRIu32 "\n",
+                (shared[i]->line - 1) << coh->offsetbits, shared[i]->false_misses,
+                shared[i]->true_misses);
+    free(shared);
+}
@@ -0,0 +1,96 @@
+/*
+ * coherence.h - Private L1s kept coherent by MESI over a snooping bus
+ */
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "cache.h"
+
+#define COH_MAX_CORES 16
+
+enum mesi_t {
+    MESI_I, // invalid
+    MESI_S, // shared, clean, maybe in other cores too
+    MESI_E, // exclusive, clean, only here
+    MESI_M, // modified, only here
+};
+
+// coherence_access result flags, besides CACHE_HIT, from cache.h's 0x20 up
+#define COH_UPGRADE   0x20 // a write hit in S had to invalidate other copies
+#define COH_COHERENCE 0x40 // a miss because another core invalidated the line
+#define COH_FALSE     0x80 // ... and none of the bytes it then wrote were accessed
+
+/*
+ * The directory: every line any core has touched, with each core's MESI
+ * state, whether it lost the line to an invalidation (rather than an
+ * eviction) and which bytes other cores have written to it since. A
+ * line is in a core's L1 exactly when its state there is not MESI_I.
+ */
+struct coh_line {
+    uint64_t line;          // line number + 1, 0 for an empty slot
+    uint8_t state[COH_MAX_CORES];
+    uint16_t lost;          // per core: invalidated since it last had the line
+    uint64_t written[COH_MAX_CORES]; // per core: granules written by others since
+    uint32_t true_misses;   // coherence misses on bytes another core wrote
+    uint32_t false_misses;  // coherence misses on other bytes of the line
+};
+
+struct coh_core {
+    struct cache_t l1; // tags and replacement only, states are in the directory
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t coherence_misses;
+    uint64_t upgrades;
+};
+
+struct coherence_t {
+    int ncores;
+    unsigned offsetbits;
+    unsigned granule_bits; // written masks track 2^granule_bits byte granules
+    struct coh_core cores[COH_MAX_CORES];
+    struct cache_t* llc;   // shared last level, NULL for straight to memory
+
+    struct coh_line* lines; // open addressing, doubled at half full
+    uint64_t mask;
+    uint64_t used;
+
+    uint64_t bus_reads;     // BusRd: read misses
+    uint64_t bus_readx;     // BusRdX: write misses
+    uint64_t bus_upgrades;  // BusUpgr: writes to S lines
+    uint64_t invalidations; // copies dropped by BusRdX or BusUpgr
+    uint64_t transfers;     // misses served by another core's copy
+    uint64_t writebacks;    // M lines flushed, on eviction or to another core
+    uint64_t mem_reads;
+    uint64_t mem_writes;
+    uint64_t true_sharing;
+    uint64_t false_sharing;
+};
+
+/*
+ * coherence_init - set up ncores private L1s of 2^s sets of E lines of
+ *     2^b bytes, sharing llc if it is not NULL. Returns 0, or -1 with a
+ *     message on stderr.
+ */
+int coherence_init(struct coherence_t* coh, int ncores, unsigned s, unsigned E,
+                   unsigned b, enum repl_policy_t policy, struct cache_t* llc);
+
+void coherence_free(struct coherence_t* coh);
+
+/*
+ * coherence_access - core reads or writes size bytes at addr (only the
+ *     line holding addr, like csim). Returns CACHE_HIT for a hit, plus
+ *     COH_UPGRADE, or for a miss COH_COHERENCE and maybe COH_FALSE.
+ */
+int coherence_access(struct coherence_t* coh, int core, uint64_t addr, unsigned size,
+                     int write);
+
+/*
+ * coherence_print - per core and bus counters, then up to top lines
+ *     with the most false sharing misses
+ */
+void coherence_print(struct coherence_t* coh, FILE* out, int top);
+
+#endif
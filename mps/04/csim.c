@@ -10,13 +10,49 @@
 
 // could use PPC to compile 2 versions of everything...
 char flag_verbose = 0;
+char flag_split = 0;
+char flag_sweep = 0;
+char flag_classify = 0;
+
+// accesses that straddled a line boundary, with -S
+uint64_t split_accesses = 0;
+
+// set when -j hands accesses to worker threads
+struct parsim_t* parallel = NULL;
+
+// with -C or -H: L1 misses classified; with -H also mapped onto the matrices
+struct classify_t* classifier = NULL;
+struct missmap_t* missmap = NULL;
+
+// with -P: demand accesses go through a prefetcher
+struct prefetch_t* prefetcher = NULL;
+
+// with -T: every access is translated first
+struct tlb_t* tlb = NULL;
 
 // simulation on 64-bit machine
 #define ADDR_BITS 64
 
 #include "cachelab.h"
-
-#include "util.h"
+#include "cache.h"
+#include "sweep.h"
+#include "parsim.h"
+#include "classify.h"
+#include "missmap.h"
+#include "prefetch.h"
+#include "tlb.h"
+#include "coherence.h"
+#include "trace.h"
+#include "tracepipe.h"
+
+// the trace, parsed on its own thread when it is streamed
+struct trace_reader tr;
+struct trace_pipe* tpipe = NULL;
+
+int next_access(struct vg_acc_t* acc)
+{
+    return tpipe ? trace_pipe_next(tpipe, acc) : trace_next(&tr, acc);
+}
 
 /*
 
@@ -30,267 +66,207 @@ Usage: ./csim-ref [-hv] -s <s> -E <E> -b <b> -t <tracefile>
 
 */
 
-// datatype to simulate cache
-struct cache_block_t
+void access_address(uint64_t addr, int write, struct hier_t* hier)
 {
-    int valid;
-    int dirty;
-    char tag[ADDR_BITS];
-    //char *block;
-};
-
-// parsed valgrind line
-struct vg_acc_t {
-
-    // request type
-    enum vg_acc_type_t {
-        VG_INSTR_LOAD = 'I',
-        VG_DATA_LOAD  = 'L',
-        VG_DATA_STORE = 'S',
-        VG_DATA_MOD   = 'M',
-    } operator;
-    // hex address
-    char address[ADDR_BITS + 1];
-    // number of bytes
-    unsigned char size;
-};
-
-
-struct cache_t {
-    uint64_t nsets;
-    uint16_t lines_per_set;
-    uint64_t block_size; // in bytes
-    uint64_t hits;
-    uint64_t misses;
-    uint64_t evictions;
-    uint64_t reads;
-    uint64_t writes;
-
-    struct cache_block_t* blocks;
-};
-
-// return 1 on failure/eof
-char parse_line(FILE* trace, struct vg_acc_t* ret, char** line, size_t* line_len)
-{
-
-read_line:;
-    int res = getline(line, line_len, trace);
-    // printf("res:%d\n", res);
-    // printf("line: %s\n", *line);
-    if (res < 0)
-        return 0;
-
-    // mutable copy of line
-    char* mline = *line;
-
-    // ignore comments
-    if (mline[0] == '-' || mline[0] == '=')
-        goto read_line;
-
-    // ignore instruction type
-    if (mline[0] == 'I') {
-        goto read_line;
-
-        // ret->operator = VG_INSTR_LOAD;
-        // mline += 3;
-    } else {
-        ret->operator = mline[1];
-        mline += 3;
+    if (parallel) {
+        parsim_access(parallel, addr, write);
+        return;
     }
 
-    // read address
-    // find comma
-    int i = 0;
-    while (mline[i] != '\0' && mline[i] != ',')
-        i++;
-    strncpy(ret->address, mline, i + 1);
+    const int walked = tlb && tlb_access(tlb, addr);
+    int res = prefetcher ? prefetch_access(prefetcher, addr, write)
+                         : hier_access(hier, addr, write);
+    enum miss_class_t cls = MISS_NONE;
 
-    ret->address[i] = '\0';
-    mline += i + 1;
-
-    // read size
-    ret->size = atoi(mline);
-
-    while (*mline != '\n')
-        mline++;
-    *mline = '\0';
-
-    // success
-    return 1;
-}
-
-// convert hex string to a binary string
-void htob(char* in, char* out)
-{
-    *out = '\0';
-    while (*in) {
-        switch (*in) {
-            case '0': strcat(out, "0000"); break;
-            case '1': strcat(out, "0001"); break;
-            case '2': strcat(out, "0010"); break;
-            case '3': strcat(out, "0011"); break;
-            case '4': strcat(out, "0100"); break;
-            case '5': strcat(out, "0101"); break;
-            case '6': strcat(out, "0110"); break;
-            case '7': strcat(out, "0111"); break;
-            case '8': strcat(out, "1000"); break;
-            case '9': strcat(out, "1001"); break;
-            case 'a': case 'A': strcat(out, "1010"); break;
-            case 'b': case 'B': strcat(out, "1011"); break;
-            case 'c': case 'C': strcat(out, "1100"); break;
-            case 'd': case 'D': strcat(out, "1101"); break;
-            case 'e': case 'E': strcat(out, "1110"); break;
-            case 'f': case 'F': strcat(out, "1111"); break;
-            default:
-                printf("invalid hex: %s\n", in);
-                abort();
-                return;
-        }
+    if (classifier) {
+        cls = classify_access(classifier, addr, !(res & CACHE_HIT),
+                              res & (CACHE_HIT | CACHE_FILL));
+        if (missmap)
+            missmap_access(missmap, addr, write, res, cls, hier->levels[0].victim);
+    }
 
-        in++;
+    if (flag_verbose) {
+        if (walked)
+            printf(" tlb-miss");
+        printf(res & CACHE_HIT ? " hit" : " miss");
+        if (res & CACHE_PREFETCHED)
+            printf(" (prefetched)");
+        if (flag_classify && cls != MISS_NONE)
+            printf(" (%s)", miss_class_name(cls));
+        if (res & CACHE_EVICT)
+            printf(" eviction");
     }
 }
 
-// parse hex str into int
-uint64_t htoi(char* in)
+/*
+ * access_range - access every L1 line that size bytes at addr cover.
+ *     Without -S only the line holding addr is touched, like csim-ref.
+ */
+void access_range(uint64_t addr, unsigned size, int write, struct hier_t* hier)
 {
-    unsigned int ret = 0;
-    while (*in) {
-        switch (*in) {
-            case '0': break;
-            case '1': ret += 1; break;
-            case '2': ret += 2; break;
-            case '3': ret += 3; break;
-            case '4': ret += 4; break;
-            case '5': ret += 5; break;
-            case '6': ret += 6; break;
-            case '7': ret += 7; break;
-            case '8': ret += 8; break;
-            case '9': ret += 9; break;
-            case 'a': ret += 10; break;
-            case 'b': ret += 11; break;
-            case 'c': ret += 12; break;
-            case 'd': ret += 13; break;
-            case 'e': ret += 14; break;
-            case 'f': ret += 15; break;
-            default: printf("invalid hex string: %s\n", in);
-        }
-        in++;
-        ret <<= 4;
+    const unsigned b = hier->levels[0].offsetbits;
+
+    if (!flag_split || size < 2) {
+        access_address(addr, write, hier);
+        return;
     }
-    return ret >> 4;
-}
 
-void itoh(uint64_t n, char* ret)
-{
-    sprintf(ret, "%lx", n);
+    const uint64_t first = addr >> b, last = (addr + size - 1) >> b;
+    if (first != last)
+        split_accesses++;
+    access_address(addr, write, hier);
+    for (uint64_t line = first + 1; line <= last; line++)
+        access_address(line << b, write, hier);
 }
 
-uint64_t btoi(char *bin)
+/*
+ * parse_write - apply a comma separated list of write policies
+ *     (wb, wt, wa, nwa) to cache. Returns 0 on success.
+ */
+int parse_write(char* list, struct cache_t* cache)
 {
-    int  b, k, m, n;
-    uint64_t  len, sum;
-
-    sum = 0;
-    len = strlen(bin) - 1;
-
-    for(k = 0; k <= len; k++) {
-        n = (bin[k] - '0');
-        if ((n > 1) || (n < 0))
-            return 0;
-        for(b = 1, m = len; m > k; m--)
-            b *= 2;
-        sum = sum + n * b;
-    }
-    return(sum);
+    for (char* w = strtok(list, ","); w; w = strtok(NULL, ","))
+        if (write_policy_parse(cache, w) < 0)
+            return fprintf(stderr, "Unknown write policy %s\n", w);
+    return 0;
 }
 
-void itob(uint64_t num, char* ret)
+/*
+ * parse_level - read a lower level given as
+ *     -L s,E,b[,policy[,inclusion[,write...]]]
+ *     and append it to the hierarchy. Returns 0 on success.
+ */
+int parse_level(const char* arg, struct hier_t* hier)
 {
-    ret[ADDR_BITS] = '\0';
-    for(int i = 0; i < ADDR_BITS; i++)
-        ret[ADDR_BITS - 1 - i] = (num == ((1ULL << i) | num)) ? '1' : '0';
-    return;
+    int s, E, b;
+    char policy[16] = "lru", incl[16] = "nine", write[32] = "";
+
+    if (hier->nlevels + 1 == HIER_MAX_LEVELS)
+        return fprintf(stderr, "At most %d levels\n", HIER_MAX_LEVELS);
+    int n = sscanf(arg, "%d,%d,%d,%15[^,],%15[^,],%31s", &s, &E, &b, policy, incl, write);
+    if (n < 3 || s < 0 || E < 1 || b < 1 || s + b >= ADDR_BITS)
+        return fprintf(stderr, "Invalid -L %s, expected s,E,b[,policy[,inclusion[,write...]]]\n", arg);
+
+    int p = repl_policy_parse(policy);
+    if (p < 0)
+        return fprintf(stderr, "Unknown replacement policy %s\n", policy);
+    int i = incl_policy_parse(incl);
+    if (i < 0)
+        return fprintf(stderr, "Unknown inclusion policy %s\n", incl);
+
+    // level 0 is filled in from -s/-E/-b once all options are read
+    int lvl = ++hier->nlevels;
+    hier->incl[lvl] = i;
+    if (cache_init(&hier->levels[lvl], s, E, b, p) < 0)
+        return 1;
+    return parse_write(write, &hier->levels[lvl]);
 }
 
-void read_address(char* tag, char* set, char* block, struct cache_t* cache)
+/*
+ * run_sweep - read the whole trace into memory and print LRU miss curves
+ *     for up to 2^smax sets, emax ways and each block size in [bmin, bmax]
+ */
+int run_sweep(int smax, int emax, int bmin, int bmax)
 {
-    // look for it
-    for (int i = 0; i < cache->lines_per_set; i++) {
-        struct cache_block_t b = cache->blocks[btoi(set) * cache->lines_per_set + i];
-        if (b.valid && strcmp(b.tag, tag) == 0) {
-            cache->hits++;
-            if (flag_verbose)
-                printf(" hit");
-            return;
-        }
-    }
-
-    // not in cache
-    cache->misses++;
-    if (flag_verbose)
-        printf(" miss");
-
+    size_t n = 0, cap = 1 << 16;
+    uint64_t* addrs = (uint64_t*) malloc(cap * sizeof(uint64_t));
+    struct vg_acc_t cmd;
 
-    struct cache_block_t* b;
-    for (int i = 0; i < cache->lines_per_set; i++) {
-        b = &cache->blocks[btoi(set) * cache->lines_per_set + i];
-        // found unoccupied block
-        if (!b->valid) {
-            strcpy(b->tag, tag);
-            b->valid = 1;
-            return;
+    if (!addrs)
+        return fprintf(stderr, "could not allocate trace\n");
+
+    while (next_access(&cmd)) {
+        if (n + 2 > cap) {
+            uint64_t* grown = (uint64_t*) realloc(addrs, 2 * cap * sizeof(uint64_t));
+            if (!grown) {
+                free(addrs);
+                return fprintf(stderr, "could not allocate trace\n");
+            }
+            addrs = grown;
+            cap *= 2;
         }
+        // a modify is a load and a store, like everywhere else
+        if (cmd.operator == VG_DATA_LOAD || cmd.operator == VG_DATA_MOD)
+            addrs[n++] = cmd.address;
+        if (cmd.operator == VG_DATA_STORE || cmd.operator == VG_DATA_MOD)
+            addrs[n++] = cmd.address;
     }
-
-    if (b->valid) {
-        cache->evictions++;
-        if (flag_verbose)
-            printf(" eviction");
+    if (tr.error) {
+        free(addrs);
+        return fprintf(stderr, "could not read all of the trace\n");
     }
 
-    strcpy(b->tag, tag);
-    b->valid = 1;
-
+    int ret = sweep_run(addrs, n, bmin, bmax, smax, emax, stdout);
+    if (ret < 0)
+        fprintf(stderr, "could not allocate sweep\n");
+    free(addrs);
+    return ret < 0;
 }
 
-void write_address(char* tag, char* set, char* block, struct cache_t* cache)
+/*
+ * run_coherence - simulate coh's cores, taking accesses either from the
+ *     one trace, thread T<n> running on core n mod ncores, or round robin
+ *     from one trace per core, files[0] being the one already open
+ */
+int run_coherence(struct coherence_t* coh, char** files, int nfiles)
 {
-    // look for it
-    for (int i = 0; i < cache->lines_per_set; i++) {
-        struct cache_block_t b = cache->blocks[btoi(set) * cache->lines_per_set + i];
-        if (b.valid && strcmp(b.tag, tag) == 0) {
-            cache->hits++;
-            if (flag_verbose)
-                printf(" hit");
-            return;
+    struct trace_reader more[COH_MAX_CORES];
+    int live = nfiles, ret = 0;
+    struct vg_acc_t cmd;
+
+    for (int i = 1; i < nfiles; i++)
+        if (trace_open(&more[i], files[i]) < 0) {
+            fprintf(stderr, "could not open file %s\n", files[i]);
+            while (--i > 0)
+                trace_close(&more[i]);
+            return 1;
         }
-    }
 
-    // not in cache
-    cache->misses++;
-    if (flag_verbose)
-        printf(" miss");
-
-    struct cache_block_t* b;
-    for (int i = 0; i < cache->lines_per_set; i++) {
-        b = &cache->blocks[btoi(set) * cache->lines_per_set + i];
-        // found unoccupied block
-        if (!b->valid) {
-            strcpy(b->tag, tag);
-            b->valid = 1;
-            return;
+    for (int turn = 0; live; turn = (turn + 1) % nfiles) {
+        int core;
+        if (nfiles == 1) {
+            if (!next_access(&cmd)) {
+                if (tr.error)
+                    ret = fprintf(stderr, "could not read all of %s\n", files[0]);
+                break;
+            }
+            core = cmd.thread % coh->ncores;
+        } else {
+            // files that have ended are closed and skipped
+            core = turn;
+            if (!files[core])
+                continue;
+            if (!(core ? trace_next(&more[core], &cmd) : next_access(&cmd))) {
+                if (core ? more[core].error : tr.error)
+                    ret = fprintf(stderr, "could not read all of %s\n", files[core]);
+                if (core)
+                    trace_close(&more[core]);
+                files[core] = NULL;
+                live--;
+                continue;
+            }
         }
-    }
 
-    if (b->valid) {
-        cache->evictions++;
         if (flag_verbose)
-            printf(" eviction");
+            printf("T%d %c %" PRIx64 ",%d", core, cmd.operator, cmd.address, cmd.size);
+        for (int write = 0; write < 2; write++) {
+            if (write ? cmd.operator == VG_DATA_LOAD : cmd.operator == VG_DATA_STORE)
+                continue;
+            int res = coherence_access(coh, core, cmd.address, cmd.size, write);
+            if (flag_verbose) {
+                printf(res & CACHE_HIT ? " hit" : " miss");
+                if (res & COH_UPGRADE)
+                    printf(" upgrade");
+                if (res & COH_FALSE)
+                    printf(" (false sharing)");
+                else if (res & COH_COHERENCE)
+                    printf(" (coherence)");
+            }
+        }
+        if (flag_verbose)
+            printf(" \n");
     }
-
-    strcpy(b->tag, tag);
-    b->valid = 1;
+    return ret;
 }
 
 int main(int argc, char** argv)
@@ -298,127 +274,279 @@ int main(int argc, char** argv)
 
     int c;
 
-    int nsets = 0, lines_per_set = 0, block_size = 0;
+    int lines_per_set = 0;
     char* trace_file = NULL;
-    int setbits = 0, offsetbits = 0;
+    int setbits = 0, offsetbits = 0, offsetbits_max = 0;
+    int policy = REPL_LRU;
+    char* write_policy = NULL;
+    int nthreads = 0;
+    struct parsim_t par;
+    struct hier_t hier = { .nlevels = 0 };
+    char* map_prefix = NULL;
+    struct classify_t cls;
+    struct missmap_t map;
+    char* prefetch_spec = NULL;
+    struct prefetch_t pf;
+    char* tlb_spec = NULL;
+    struct tlb_t tlb_state;
+    int ncores = 0;
+    char* trace_files[COH_MAX_CORES];
+    int ntrace_files = 0;
+    struct coherence_t coh;
 
     // read command line args
-    while ((c = getopt(argc, argv, "hvs:E:b:t:")) != -1) {
+    while ((c = getopt(argc, argv, "hvSCms:E:b:t:r:L:w:j:H:P:T:c:")) != -1) {
         switch (c) {
             case 'h':
-                printf("Usage: ./csim-ref [-hv] -s <s> -E <E> -b <b> -t <tracefile>\n"
+                printf("Usage: ./csim [-hvSCm] -s <s> -E <E> -b <b> [-r <policy>] [-w <write>]\n"
+                "\t     [-j <threads>] [-L <level>]... [-P <prefetcher>]\n"
+                "\t     [-T <tlb>] [-H <prefix>] [-c <cores>] -t <tracefile>...\n"
                 "\t-h: Optional help flag that prints usage info\n"
                 "\t-v: Optional verbose flag that displays trace info\n"
+                "\t-S: Split accesses that straddle cache lines, instead of only\n"
+                "\t    touching the line of their first byte like csim-ref\n"
+                "\t-C: Class L1 misses as compulsory, capacity or conflict against a\n"
+                "\t    fully associative LRU cache of the same size\n"
+                "\t-m: Sweep: print LRU miss curves for every cache of up to 2^s sets\n"
+                "\t    and E ways; -b may then be a range such as 4-6\n"
                 "\t-s <s>: Number of set index bits (S = 2^s is the number of sets)\n"
                 "\t-E <E>: Associativity (number of lines per set)\n"
                 "\t-b <b>: Number of block offset bits (B = 2^b is the block size)\n"
-                "\t-t <tracefile>: Name of the valgrind trace to replay)\n");
+                "\t-r <policy>: Replacement policy: lru (default), fifo, random, plru,\n"
+                "\t             srrip or brrip\n"
+                "\t-w <write>: Write policies, comma separated: wb (write-back, default)\n"
+                "\t             or wt (write-through), wa (write-allocate, default)\n"
+                "\t             or nwa (no-write-allocate)\n"
+                "\t-j <threads>: Simulate on this many threads, each owning a range\n"
+                "\t             of sets (not with -v, -m, -L, -C, -H, -P, -T or -c)\n"
+                "\t-L <s,E,b[,policy[,inclusion[,write...]]]>: Add a lower cache level\n"
+                "\t             (L2, L3, ...) with inclusion nine (default), inclusive\n"
+                "\t             or exclusive\n"
+                "\t-P <kind[,degree[,distance[,latency]]]>: Prefetch into L1 with a\n"
+                "\t             next-line, stream (stride) or pair (adjacent line)\n"
+                "\t             prefetcher; latency is in accesses (default 4)\n"
+                "\t-T <l1entries,l1ways[,l2entries,l2ways[,page[,cycles]]]>: Translate\n"
+                "\t             through a data TLB of 4k or 2m pages first; cycles is\n"
+                "\t             the cost per page table level a walk reads (default 20)\n"
+                "\t-c <cores>: Give this many cores private MESI L1s, sharing an -L\n"
+                "\t             LLC if there is one. Accesses tagged T<n> run on core\n"
+                "\t             n mod cores, or give one -t per core\n"
+                "\t-H <prefix>: Map each L1 miss, classed as compulsory, capacity or\n"
+                "\t             conflict, onto the matrices in <tracefile>.info:\n"
+                "\t             writes <prefix>.csv, <prefix>-misses.csv, <prefix>.ppm\n"
+                "\t-t <tracefile>: Name of the valgrind trace to replay, - or none\n"
+                "\t             for stdin; pipes are parsed while they are written\n");
                 return 0;
             case 'v':
                 flag_verbose = 1;
                 break;
+            case 'S':
+                flag_split = 1;
+                break;
+            case 'C':
+                flag_classify = 1;
+                break;
+            case 'm':
+                flag_sweep = 1;
+                break;
             case 's':
                 setbits = atoi(optarg);
-                nsets = 1 << setbits;
                 break;
             case 'E':
                 lines_per_set = atoi(optarg);
                 break;
             case 'b':
-                offsetbits = atoi(optarg);
-                block_size = 1 << offsetbits;
+                if (sscanf(optarg, "%d-%d", &offsetbits, &offsetbits_max) < 2)
+                    offsetbits_max = offsetbits;
                 break;
             case 't':
-                trace_file = optarg;
+                if (ntrace_files == COH_MAX_CORES)
+                    return fprintf(stderr, "At most %d traces\n", COH_MAX_CORES);
+                trace_files[ntrace_files++] = optarg;
+                trace_file = trace_files[0];
+                break;
+            case 'r':
+                policy = repl_policy_parse(optarg);
+                if (policy < 0)
+                    return fprintf(stderr, "Unknown replacement policy %s\n", optarg);
+                break;
+            case 'w':
+                write_policy = optarg;
+                break;
+            case 'j':
+                nthreads = atoi(optarg);
+                if (nthreads < 1 || nthreads > PARSIM_MAX_WORKERS)
+                    return fprintf(stderr, "-j takes 1 to %d threads\n", PARSIM_MAX_WORKERS);
+                break;
+            case 'L':
+                if (parse_level(optarg, &hier))
+                    return 1;
+                break;
+            case 'H':
+                map_prefix = optarg;
+                break;
+            case 'P':
+                prefetch_spec = optarg;
+                break;
+            case 'T':
+                tlb_spec = optarg;
+                break;
+            case 'c':
+                ncores = atoi(optarg);
+                if (ncores < 1 || ncores > COH_MAX_CORES)
+                    return fprintf(stderr, "-c takes 1 to %d cores\n", COH_MAX_CORES);
                 break;
             default:
                 abort();
         }
     }
 
-    // printf("%d %d %d %p\n",nsets, lines_per_set, block_size, trace_file );
-
     // missing/invalid args
-    if (setbits < 1)
+    if (offsetbits_max != offsetbits && !flag_sweep)
+        return fprintf(stderr, "-b ranges need -m\n");
+    if (nthreads && (flag_verbose || flag_sweep || hier.nlevels || flag_classify || map_prefix
+                     || prefetch_spec || tlb_spec || ncores))
+        return fprintf(stderr, "-j only works without -v, -m, -L, -C, -H, -P, -T and -c\n");
+    if (ntrace_files > 1 && ncores != ntrace_files)
+        return fprintf(stderr, "several -t need -c with a core for each\n");
+    if (ncores && (flag_sweep || flag_split || flag_classify || map_prefix || prefetch_spec
+                   || tlb_spec || write_policy || hier.nlevels > 1))
+        return fprintf(stderr, "-c only works with -v, -r and one -L\n");
+    if (ncores && hier.nlevels && (hier.incl[1] != INCL_NINE || hier.levels[1].write_through
+                                   || hier.levels[1].no_write_allocate))
+        return fprintf(stderr, "-c's LLC is always nine and write-back, write-allocate\n");
+    if ((flag_classify || map_prefix || prefetch_spec || tlb_spec) && flag_sweep)
+        return fprintf(stderr, "-C, -H, -P and -T do not work with -m\n");
+    if (setbits < (flag_sweep ? 0 : 1))
         return fprintf(stderr, "Missing/invalid -s option\n");
     if (lines_per_set < 1)
         return fprintf(stderr, "Missing/invalid -E option\n");
     if (offsetbits < 1)
         return fprintf(stderr, "Missing/invalid -b option\n");
-    if (trace_file == NULL)
-        return fprintf(stderr, "Missing/invalid -t option\n");
+    if (trace_file == NULL) {
+        if (isatty(STDIN_FILENO))
+            return fprintf(stderr, "Missing/invalid -t option\n");
+        trace_file = "-";
+    }
+    if (offsetbits_max < offsetbits || setbits + offsetbits_max >= ADDR_BITS)
+        return fprintf(stderr, "-s and -b leave no tag bits\n");
 
-    FILE* f = fopen(trace_file, "r");
-    if (!f)
+    if (trace_open(&tr, trace_file) < 0)
         return fprintf(stderr, "could not open file %s", trace_file);
 
-    const unsigned int tagsize = ADDR_BITS - offsetbits - setbits;
-
-    // initialize cache
-    struct cache_t cache = { .nsets=nsets,  .lines_per_set = lines_per_set, .block_size=block_size,
-        .hits=0, .misses=0, .evictions=0, .reads=0, .writes=0 };
-
-    // initialize cache blocks
-    cache.blocks = (struct cache_block_t*) calloc(sizeof(struct cache_block_t), nsets * lines_per_set + 2);
-    for (unsigned int i = 0; i < nsets * lines_per_set; i++) {
-        for (unsigned int j = 0; j < tagsize; j++)
-            cache.blocks[i].tag[j] = '0';
-        cache.blocks[i].tag[tagsize] = '\0';
-
-        cache.blocks[i].valid = 0;
-        cache.blocks[i].dirty = 0;
+    // keep up with a pipe by parsing on another thread
+    struct trace_pipe tp;
+    if (!tr.mapped) {
+        if (trace_pipe_start(&tp, &tr) < 0)
+            return fprintf(stderr, "could not start parser thread\n");
+        tpipe = &tp;
     }
 
+    if (flag_sweep) {
+        int ret = run_sweep(setbits, lines_per_set, offsetbits, offsetbits_max);
+        if (tpipe)
+            trace_pipe_stop(tpipe);
+        trace_close(&tr);
+        return ret;
+    }
 
-    const unsigned tagbits = ADDR_BITS - setbits - offsetbits;
+    if (ncores) {
+        struct cache_t* llc = hier.nlevels ? &hier.levels[1] : NULL;
+        int ret = coherence_init(&coh, ncores, setbits, lines_per_set, offsetbits, policy,
+                                 llc) < 0;
+        if (!ret) {
+            ret = run_coherence(&coh, trace_files, ntrace_files ? ntrace_files : 1);
+            if (!ret)
+                coherence_print(&coh, stdout, 10);
+            coherence_free(&coh);
+        }
+        if (hier.nlevels)
+            cache_free(llc);
+        if (tpipe)
+            trace_pipe_stop(tpipe);
+        trace_close(&tr);
+        return ret;
+    }
 
-    char tag[ADDR_BITS];
-    char set[ADDR_BITS];
-    char offset[ADDR_BITS];
-    char addr[ADDR_BITS + 1];
+    // initialize cache, L1 comes first
+    hier.nlevels++;
+    if (cache_init(&hier.levels[0], setbits, lines_per_set, offsetbits, policy) < 0)
+        return 1;
+    struct cache_t* l1 = &hier.levels[0];
+    if (write_policy && parse_write(write_policy, l1))
+        return 1;
+    if (tlb_spec) {
+        if (tlb_init(&tlb_state, tlb_spec) < 0)
+            return 1;
+        tlb = &tlb_state;
+    }
+    if (prefetch_spec) {
+        if (prefetch_init(&pf, &hier, prefetch_spec) < 0)
+            return 1;
+        prefetcher = &pf;
+    }
+    if (flag_classify || map_prefix) {
+        if (classify_init(&cls, l1->nsets * l1->lines_per_set, offsetbits) < 0)
+            return fprintf(stderr, "could not allocate the shadow cache\n");
+        classifier = &cls;
+    }
+    if (map_prefix) {
+        if (missmap_open(&map, trace_file, map_prefix, l1->block_size) < 0)
+            return 1;
+        missmap = &map;
+    }
+    if (nthreads) {
+        if (parsim_start(&par, nthreads, l1) < 0)
+            return fprintf(stderr, "could not start worker threads\n");
+        parallel = &par;
+    }
 
-    size_t line_len = 150;
-    char* line = (char*) calloc(sizeof(char), line_len);
     struct vg_acc_t cmd;
-    while (parse_line(f, &cmd, &line, &line_len)) {
-        // the reference appears to ignore the size component...
-        // so I won't bother with it
-        //while (cmd.size) {
-        itob(htoi(cmd.address), addr);
-
-        strncpy(tag, addr, tagbits);
-        tag[tagbits] = '\0';
-        strncpy(set, addr + tagbits, setbits);
-        set[setbits] = '\0';
-        strcpy(offset, addr + tagbits + setbits);
-
-        if (flag_verbose) {
-            //printf("addrh: %s\n", cmd.address);
-            printf("addrb: %s\n", addr);
-            printf("tag: %s\n", tag);
-            printf("set: %s\n", set);
-            printf("offset: %s\n", offset);
-        }
-
+    while (next_access(&cmd)) {
+        // the reference appears to ignore the size component,
+        // so it only matters with -S
         if (flag_verbose)
-            printf("\n%s ", line[0] == ' ' ? (line + 1) : line);
+            printf("%c %" PRIx64 ",%d", cmd.operator, cmd.address, cmd.size);
 
         if (cmd.operator == VG_DATA_LOAD || cmd.operator == VG_DATA_MOD)
-            read_address(tag, set, offset, &cache);
+            access_range(cmd.address, cmd.size, 0, &hier);
         if (cmd.operator == VG_DATA_STORE ||  cmd.operator == VG_DATA_MOD)
-            write_address(tag, set, offset, &cache);
+            access_range(cmd.address, cmd.size, 1, &hier);
 
         // endl
         if (flag_verbose)
-            putc('\n', stdout);
-
-
-        // itoh(htoi(cmd.address) - 1, cmd.address);
-        //     cmd.size--;
-        // }
+            printf(" \n");
     }
 
-    printSummary(cache.hits, cache.misses, cache.evictions);
-
+    if (parallel)
+        parsim_finish(parallel, &hier);
+    if (tr.error)
+        return fprintf(stderr, "could not read all of %s\n", trace_file);
+
+    printSummary(l1->hits, l1->misses, l1->evictions);
+    if (flag_classify)
+        printf("compulsory:%" PRIu64 " capacity:%" PRIu64 " conflict:%" PRIu64 "\n",
+               cls.counts[MISS_COMPULSORY], cls.counts[MISS_CAPACITY],
+               cls.counts[MISS_CONFLICT]);
+    if (hier.nlevels > 1 || write_policy)
+        hier_print(&hier, stdout);
+    if (flag_split)
+        printf("split accesses:%" PRIu64 "\n", split_accesses);
+    if (tlb)
+        tlb_print(tlb, stdout);
+    if (prefetcher)
+        printf("prefetches: issued:%" PRIu64 " useful:%" PRIu64 " late:%" PRIu64
+               " polluting:%" PRIu64 "\n", pf.issued, pf.useful, pf.late, pf.polluting);
+    if (missmap && missmap_close(missmap) < 0)
+        return fprintf(stderr, "could not write the miss map\n");
+    if (classifier)
+        classify_free(classifier);
+    if (tlb)
+        tlb_free(tlb);
+
+    hier_free(&hier);
+    if (tpipe)
+        trace_pipe_stop(tpipe);
+    trace_close(&tr);
     return 0;
 }
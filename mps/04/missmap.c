@@ -0,0 +1,185 @@
+/*
+ * missmap.c - Attribute L1 misses and evictions to elements of A and B
+ *
+ * Addresses are turned into elements with cachelab.c's converter, from
+ * the .info file test-trans writes next to each trace.f*. A miss counts
+ * against the element accessed; an eviction against every element of
+ * the victim line.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "cachelab.h"
+#include "missmap.h"
+
+// longest "A[16383][16383]" or hex address
+#define ELEMENT_LEN 40
+
+int missmap_open(struct missmap_t* mm, const char* trace_file, const char* prefix,
+                 unsigned block_size)
+{
+    char path[4096];
+
+    memset(mm, 0, sizeof(*mm));
+    initializeArrayAccessConverter(trace_file);
+    if (!arrayAccessDimensions(&mm->M, &mm->N) || mm->M < 1 || mm->N < 1) {
+        fprintf(stderr, "-H needs %s.info, as test-trans writes it\n", trace_file);
+        return -1;
+    }
+    mm->block_size = block_size;
+    mm->prefix = (char*) malloc(strlen(prefix) + 1);
+    if (mm->prefix)
+        strcpy(mm->prefix, prefix);
+    for (int k = 0; k < 2; k++)
+        mm->cells[k] = (struct missmap_cell*) calloc((size_t) mm->M * mm->N,
+                                                     sizeof(struct missmap_cell));
+    if (!mm->prefix || !mm->cells[0] || !mm->cells[1]) {
+        fprintf(stderr, "could not allocate the miss map\n");
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s-misses.csv", prefix);
+    mm->events = fopen(path, "w");
+    if (!mm->events) {
+        perror(path);
+        return -1;
+    }
+    fprintf(mm->events, "op,address,element,class,victim\n");
+    return 0;
+}
+
+// cell for addr, or NULL if it is in neither matrix
+static struct missmap_cell* cell(struct missmap_t* mm, uint64_t addr)
+{
+    int row, col;
+
+    switch (addressToArrayIndex(addr, &row, &col)) {
+        case 'A':
+            return &mm->cells[0][(size_t) row * mm->M + col];
+        case 'B':
+            return &mm->cells[1][(size_t) row * mm->N + col];
+    }
+    return NULL;
+}
+
+void missmap_access(struct missmap_t* mm, uint64_t addr, int write, int res,
+                    enum miss_class_t cls, uint64_t victim)
+{
+    struct missmap_cell* c = cell(mm, addr);
+    char element[ELEMENT_LEN], victim_element[ELEMENT_LEN] = "";
+
+    if (c) {
+        c->accesses++;
+        if (cls != MISS_NONE)
+            c->misses[cls]++;
+    }
+    if (res & CACHE_EVICT) {
+        for (uint64_t a = victim; a < victim + mm->block_size; a += sizeof(int)) {
+            struct missmap_cell* v = cell(mm, a);
+            if (v)
+                v->evicted++;
+        }
+        addressToArrayAccess(victim_element, victim);
+    }
+    if (cls != MISS_NONE) {
+        addressToArrayAccess(element, addr);
+        fprintf(mm->events, "%c,%" PRIx64 ",%s,%s,%s\n", write ? 'S' : 'L', addr,
+                element, miss_class_name(cls), victim_element);
+    }
+}
+
+static void write_csv(struct missmap_t* mm, FILE* out)
+{
+    fprintf(out, "matrix,row,col,accesses,misses,compulsory,capacity,conflict,evicted\n");
+    for (int k = 0; k < 2; k++) {
+        const int rows = k ? mm->M : mm->N, cols = k ? mm->N : mm->M;
+        for (int i = 0; i < rows; i++)
+            for (int j = 0; j < cols; j++) {
+                const struct missmap_cell* c = &mm->cells[k][(size_t) i * cols + j];
+                fprintf(out, "%c,%d,%d,%u,%u,%u,%u,%u,%u\n", k ? 'B' : 'A', i, j,
+                        c->accesses,
+                        c->misses[MISS_COMPULSORY] + c->misses[MISS_CAPACITY] +
+                        c->misses[MISS_CONFLICT],
+                        c->misses[MISS_COMPULSORY], c->misses[MISS_CAPACITY],
+                        c->misses[MISS_CONFLICT], c->evicted);
+            }
+    }
+}
+
+/*
+ * write_ppm - A and B side by side, a column apart, each element a
+ *     square of pixels sized so the image is about 512 wide. Each channel
+ *     is one class's misses over the most any element had of any class.
+ *     Elements never accessed are dark grey, like the background.
+ */
+static void write_ppm(struct missmap_t* mm, FILE* out)
+{
+    const int height = mm->M > mm->N ? mm->M : mm->N, width = mm->M + 1 + mm->N;
+    const int scale = width < 512 ? 512 / width : 1;
+    uint32_t most = 1;
+
+    for (int k = 0; k < 2; k++)
+        for (size_t i = 0; i < (size_t) mm->M * mm->N; i++)
+            for (int m = 0; m < MISS_CLASSES; m++)
+                if (mm->cells[k][i].misses[m] > most)
+                    most = mm->cells[k][i].misses[m];
+
+    fprintf(out, "P6\n%d %d\n255\n", width * scale, height * scale);
+    unsigned char* line = (unsigned char*) malloc((size_t) width * scale * 3);
+    if (!line)
+        return;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            // which matrix, and its element, this column is
+            const int k = x > mm->M;
+            const int rows = k ? mm->M : mm->N, cols = k ? mm->N : mm->M;
+            const int col = k ? x - mm->M - 1 : x;
+            unsigned char rgb[3] = { 32, 32, 32 };
+
+            if (x != mm->M && y < rows) {
+                const struct missmap_cell* c = &mm->cells[k][(size_t) y * cols + col];
+                if (c->accesses) {
+                    rgb[0] = 255 * c->misses[MISS_CONFLICT] / most;
+                    rgb[1] = 255 * c->misses[MISS_CAPACITY] / most;
+                    rgb[2] = 255 * c->misses[MISS_COMPULSORY] / most;
+                }
+            }
+            for (int s = 0; s < scale; s++)
+                memcpy(line + 3 * ((size_t) x * scale + s), rgb, 3);
+        }
+        for (int s = 0; s < scale; s++)
+            fwrite(line, 3, (size_t) width * scale, out);
+    }
+    free(line);
+}
+
+int missmap_close(struct missmap_t* mm)
+{
+    char path[4096];
+    int err = fclose(mm->events) != 0;
+    FILE* out;
+
+    snprintf(path, sizeof(path), "%s.csv", mm->prefix);
+    if ((out = fopen(path, "w"))) {
+        write_csv(mm, out);
+        err |= fclose(out) != 0;
+    } else {
+        perror(path);
+        err = 1;
+    }
+
+    snprintf(path, sizeof(path), "%s.ppm", mm->prefix);
+    if ((out = fopen(path, "wb"))) {
+        write_ppm(mm, out);
+        err |= fclose(out) != 0;
+    } else {
+        perror(path);
+        err = 1;
+    }
+
+    free(mm->cells[0]);
+    free(mm->cells[1]);
+    free(mm->prefix);
+    return err ? -1 : 0;
+}
@@ -0,0 +1,50 @@
+/*
+ * missmap.h - Attribute L1 misses and evictions to elements of A and B
+ */
+#ifndef MISSMAP_H
+#define MISSMAP_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "classify.h"
+
+// what happened to one matrix element
+struct missmap_cell {
+    uint32_t accesses;
+    uint32_t misses[MISS_CLASSES];
+    uint32_t evicted; // times the line holding it was evicted
+};
+
+struct missmap_t {
+    int M, N;             // A is N rows of M, B is M rows of N
+    unsigned block_size;
+    struct missmap_cell* cells[2]; // A, B
+    FILE* events;         // <prefix>-misses.csv
+    char* prefix;
+};
+
+/*
+ * missmap_open - map the matrices described by <trace_file>.info (as
+ *     test-trans writes it) and start <prefix>-misses.csv, a line per
+ *     miss: the element missed on, its class and the victim evicted.
+ *     Returns 0, or -1 with a message on stderr.
+ */
+int missmap_open(struct missmap_t* mm, const char* trace_file, const char* prefix,
+                 unsigned block_size);
+
+/*
+ * missmap_access - record an L1 access: res as cache_access returned it,
+ *     cls as classify_access did and victim the line it evicted, if any
+ */
+void missmap_access(struct missmap_t* mm, uint64_t addr, int write, int res,
+                    enum miss_class_t cls, uint64_t victim);
+
+/*
+ * missmap_close - write <prefix>.csv, a line per element, and
+ *     <prefix>.ppm, a heatmap of A beside B with conflict misses in red,
+ *     capacity in green and compulsory in blue. Returns 0 or -1.
+ */
+int missmap_close(struct missmap_t* mm);
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * parsim.c - Single level cache simulation sharded across threads by set
+ *
+ * Sets never interact, so the reader (the calling thread) hands each
+ * access to the worker owning its set through that worker's SPSC ring,
+ * and the per worker counters add up to exactly what one thread would
+ * count. Only random and BRRIP replacement, whose state is per cache
+ * rather than per set, can decide differently than a single thread.
+ *
+ * Ring entries are the line address shifted left once, with the write
+ * flag in bit 0. b >= 1, so no address bits are lost.
+ *
+ * Each worker's cache only has room for the sets it owns, rounded up to
+ * a power of 2, so -j does not multiply the cache's memory. A worker
+ * renumbers its sets from 0 and keeps the tag above them, which maps
+ * lines to its cache one to one and so changes none of the counts.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "parsim.h"
+
+#define RING_SIZE (1 << 16)
+
+// yield this many times in a row before sleeping between polls
+#define SPIN_LIMIT 64
+
+/*
+ * backoff - wait a little for the other end of a ring. Spinning alone
+ *     would steal the CPU from the reader when there are more threads
+ *     than cores.
+ */
+static void backoff(int* spins)
+{
+    if (++*spins < SPIN_LIMIT) {
+        sched_yield();
+    } else {
+        struct timespec ts = { 0, 50 * 1000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static void* worker_main(void* arg)
+{
+    struct parsim_worker* w = (struct parsim_worker*) arg;
+    const unsigned b = w->hier.levels[0].offsetbits;
+    const unsigned local_bits = w->hier.levels[0].setbits;
+    const uint64_t set_mask = (1ULL << w->setbits) - 1;
+    uint64_t batch[256];
+    int closed, spins = 0;
+
+    for (;;) {
+        size_t n = spsc_pop(&w->ring, batch, 256, &closed);
+        if (n == 0) {
+            if (closed)
+                return NULL;
+            backoff(&spins);
+            continue;
+        }
+        spins = 0;
+        for (size_t i = 0; i < n; i++) {
+            const uint64_t line = batch[i] >> 1;
+            const uint64_t local = (line >> w->setbits) << local_bits
+                                   | ((line & set_mask) - w->set_lo);
+            hier_access(&w->hier, local << b, batch[i] & 1);
+        }
+    }
+}
+
+/*
+ * stop - close the rings of the first started workers and join them,
+ *     adding their counters into total if it is not NULL, then free
+ *     every worker
+ */
+static void stop(struct parsim_t* par, int started, struct hier_t* total)
+{
+    for (int i = 0; i < started; i++)
+        spsc_close(&par->workers[i].ring);
+
+    for (int i = 0; i < par->nworkers; i++) {
+        struct parsim_worker* w = &par->workers[i];
+        struct cache_t* c = &w->hier.levels[0];
+
+        if (i < started)
+            pthread_join(w->thread, NULL);
+        if (total) {
+            struct cache_t* t = &total->levels[0];
+            t->hits += c->hits;
+            t->misses += c->misses;
+            t->evictions += c->evictions;
+            t->writebacks += c->writebacks;
+            t->write_throughs += c->write_throughs;
+            t->reads += c->reads;
+            t->writes += c->writes;
+            total->mem_reads += w->hier.mem_reads;
+            total->mem_writes += w->hier.mem_writes;
+        }
+        hier_free(&w->hier);
+        spsc_free(&w->ring);
+    }
+    free(par->workers);
+}
+
+int parsim_start(struct parsim_t* par, int nworkers, const struct cache_t* proto)
+{
+    const uint64_t nsets = 1ULL << proto->setbits;
+
+    par->nworkers = nworkers;
+    par->setbits = proto->setbits;
+    par->offsetbits = proto->offsetbits;
+    par->workers = (struct parsim_worker*) calloc(nworkers, sizeof(struct parsim_worker));
+    if (!par->workers)
+        return -1;
+
+    for (int i = 0; i < nworkers; i++) {
+        struct parsim_worker* w = &par->workers[i];
+        struct cache_t* c = &w->hier.levels[0];
+
+        // the sets parsim_access sends here, (set * nworkers) >> setbits == i
+        const uint64_t hi = ((i + 1) * nsets + nworkers - 1) / nworkers;
+        w->set_lo = (i * nsets + nworkers - 1) / nworkers;
+        w->setbits = proto->setbits;
+        unsigned local_bits = 0;
+        while ((1ULL << local_bits) < hi - w->set_lo)
+            local_bits++;
+
+        w->hier.nlevels = 1;
+        if (cache_init(c, local_bits, proto->lines_per_set, proto->offsetbits,
+                       proto->policy) < 0
+            || spsc_init(&w->ring, RING_SIZE) < 0) {
+            stop(par, i, NULL);
+            return -1;
+        }
+        c->write_through = proto->write_through;
+        c->no_write_allocate = proto->no_write_allocate;
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            fprintf(stderr, "could not start worker %d\n", i);
+            stop(par, i, NULL);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// push a worker's batch, waiting for room if it has to
+static void flush(struct parsim_worker* w)
+{
+    size_t done = 0;
+    int spins = 0;
+
+    while ((done += spsc_push(&w->ring, w->buf + done, w->nbuf - done)) < w->nbuf)
+        backoff(&spins);
+    w->nbuf = 0;
+}
+
+void parsim_access(struct parsim_t* par, uint64_t addr, int write)
+{
+    const uint64_t line = addr >> par->offsetbits;
+    const uint64_t set = line & ((1ULL << par->setbits) - 1);
+    // contiguous set ranges: the top bits of the set index pick the worker
+    struct parsim_worker* w = &par->workers[(set * par->nworkers) >> par->setbits];
+
+    w->buf[w->nbuf++] = line << 1 | (write != 0);
+    if (w->nbuf == sizeof(w->buf) / sizeof(w->buf[0]))
+        flush(w);
+}
+
+void parsim_finish(struct parsim_t* par, struct hier_t* total)
+{
+    for (int i = 0; i < par->nworkers; i++)
+        flush(&par->workers[i]);
+    stop(par, par->nworkers, total);
+}
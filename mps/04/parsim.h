@@ -0,0 +1,48 @@
+/*
+ * parsim.h - Single level cache simulation sharded across threads by set
+ */
+#ifndef PARSIM_H
+#define PARSIM_H
+
+#include <pthread.h>
+
+#include "cache.h"
+#include "spsc.h"
+
+#define PARSIM_MAX_WORKERS 64
+
+struct parsim_worker {
+    pthread_t thread;
+    struct spsc_ring ring; // accesses to this worker's sets
+    struct hier_t hier;    // just this worker's sets, renumbered from 0
+    uint64_t set_lo;       // first set it owns
+    unsigned setbits;      // of the whole cache
+    size_t nbuf;           // reader side batch, not yet pushed
+    uint64_t buf[256];
+};
+
+struct parsim_t {
+    int nworkers;
+    unsigned setbits;
+    unsigned offsetbits;
+    struct parsim_worker* workers;
+};
+
+/*
+ * parsim_start - start nworkers threads, each simulating a contiguous
+ *     range of proto's sets with its associativity, block size,
+ *     replacement and write policy. Returns 0, or -1 on failure with
+ *     any workers already started stopped and everything freed.
+ */
+int parsim_start(struct parsim_t* par, int nworkers, const struct cache_t* proto);
+
+// queue one access for the worker that owns its set
+void parsim_access(struct parsim_t* par, uint64_t addr, int write);
+
+/*
+ * parsim_finish - drain the queues, stop the workers and add their
+ *     counters into total, which must be a one level hierarchy
+ */
+void parsim_finish(struct parsim_t* par, struct hier_t* total);
+
+#endif
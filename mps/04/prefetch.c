@@ -0,0 +1,204 @@
+/*
+ * prefetch.c - Hardware prefetcher models in front of csim's L1
+ *
+ * csim has no notion of time, so a prefetch arrives a fixed number of
+ * demand accesses after it is issued. A demand access to a line still in
+ * flight counts as late and misses as usual. Prefetches only go to the
+ * hierarchy for lines neither cached nor already in flight, and count
+ * as L2 (or memory) reads like any fetch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prefetch.h"
+
+static const char* kind_names[] = {
+    [PF_NEXTLINE] = "next",
+    [PF_STREAM] = "stream",
+    [PF_PAIR] = "pair",
+};
+
+int prefetch_init(struct prefetch_t* pf, struct hier_t* hier, const char* spec)
+{
+    char kind[16];
+    unsigned degree = 0, distance = 0, latency = 4;
+    int n = sscanf(spec, "%15[^,],%u,%u,%u", kind, &degree, &distance, &latency);
+    unsigned k;
+
+    memset(pf, 0, sizeof(*pf));
+    for (k = 0; k < sizeof(kind_names) / sizeof(kind_names[0]); k++)
+        if (n >= 1 && strcmp(kind, kind_names[k]) == 0)
+            break;
+    if (k == sizeof(kind_names) / sizeof(kind_names[0])) {
+        fprintf(stderr, "-P takes next, stream or pair, then degree, distance, latency\n");
+        return -1;
+    }
+
+    pf->kind = k;
+    pf->degree = n >= 2 ? degree : (k == PF_STREAM ? 2 : 1);
+    pf->distance = n >= 3 ? distance : (k == PF_STREAM ? 4 : 1);
+    pf->latency = latency;
+    pf->hier = hier;
+    if (pf->degree < 1 || pf->degree > PF_QUEUE || pf->distance < 1) {
+        fprintf(stderr, "-P degree must be 1 to %d and distance at least 1\n", PF_QUEUE);
+        return -1;
+    }
+    return 0;
+}
+
+static uint64_t filter_slot(uint64_t line)
+{
+    return (line * 0x9e3779b97f4a7c15ULL) >> 52; // PF_FILTER == 1 << 12
+}
+
+// fill every prefetch that has arrived by now
+static void complete_due(struct prefetch_t* pf)
+{
+    struct cache_t* l1 = &pf->hier->levels[0];
+
+    while (pf->queue_len && pf->queue_due[pf->queue_head] <= pf->clock) {
+        const uint64_t line = pf->queue_line[pf->queue_head];
+        int r = hier_prefetch(pf->hier, line << l1->offsetbits);
+        if (r & CACHE_EVICT)
+            pf->filter[filter_slot(l1->victim >> l1->offsetbits)] =
+                (l1->victim >> l1->offsetbits) + 1;
+        pf->queue_head = (pf->queue_head + 1) % PF_QUEUE;
+        pf->queue_len--;
+    }
+}
+
+// index in the queue of line, -1 if it is not in flight
+static int in_flight(struct prefetch_t* pf, uint64_t line)
+{
+    for (unsigned i = 0; i < pf->queue_len; i++) {
+        unsigned q = (pf->queue_head + i) % PF_QUEUE;
+        if (pf->queue_line[q] == line)
+            return q;
+    }
+    return -1;
+}
+
+// drop queue entry q, keeping the rest in order
+static void dequeue(struct prefetch_t* pf, unsigned q)
+{
+    unsigned tail = (pf->queue_head + pf->queue_len - 1) % PF_QUEUE;
+
+    while (q != tail) {
+        unsigned next = (q + 1) % PF_QUEUE;
+        pf->queue_line[q] = pf->queue_line[next];
+        pf->queue_due[q] = pf->queue_due[next];
+        q = next;
+    }
+    pf->queue_len--;
+}
+
+static void issue(struct prefetch_t* pf, int64_t line)
+{
+    struct cache_t* l1 = &pf->hier->levels[0];
+    const uint64_t addr = (uint64_t) line << l1->offsetbits;
+
+    if (line < 0 || (uint64_t) line != addr >> l1->offsetbits)
+        return; // off either end of the address space
+    if (pf->queue_len == PF_QUEUE || in_flight(pf, line) >= 0 || cache_probe(l1, addr))
+        return;
+
+    unsigned q = (pf->queue_head + pf->queue_len) % PF_QUEUE;
+    pf->queue_line[q] = line;
+    pf->queue_due[q] = pf->clock + pf->latency;
+    pf->queue_len++;
+    pf->issued++;
+}
+
+/*
+ * stream_train - join line to the most recent stream whose last miss is
+ *     within PF_WINDOW lines, or start a stream in the least recently
+ *     used entry. Returns the stream once its stride has been seen twice
+ *     in a row, else NULL.
+ */
+static struct pf_stream* stream_train(struct prefetch_t* pf, uint64_t line)
+{
+    struct pf_stream* best = NULL;
+    struct pf_stream* oldest = &pf->streams[0];
+
+    for (int i = 0; i < PF_STREAMS; i++) {
+        struct pf_stream* s = &pf->streams[i];
+        const int64_t delta = (int64_t) (line - s->last);
+
+        if (s->stamp && !delta) {
+            s->stamp = pf->clock; // missed on the same line again
+            return NULL;
+        }
+        if (s->stamp < oldest->stamp)
+            oldest = s;
+        if (s->stamp && delta && llabs(delta) <= PF_WINDOW
+                && (!best || s->stamp > best->stamp))
+            best = s;
+    }
+
+    if (!best) {
+        oldest->last = line;
+        oldest->stride = 0;
+        oldest->confidence = 0;
+        oldest->stamp = pf->clock;
+        return NULL;
+    }
+
+    const int64_t delta = (int64_t) (line - best->last);
+    if (delta == best->stride) {
+        best->confidence++;
+    } else {
+        best->stride = delta;
+        best->confidence = 1;
+    }
+    best->last = line;
+    best->stamp = pf->clock;
+    return best->confidence >= 2 ? best : NULL;
+}
+
+int prefetch_access(struct prefetch_t* pf, uint64_t addr, int write)
+{
+    const struct cache_t* l1 = &pf->hier->levels[0];
+    const uint64_t line = addr >> l1->offsetbits;
+
+    pf->clock++;
+    complete_due(pf);
+
+    int q = in_flight(pf, line);
+    if (q >= 0) {
+        pf->late++;
+        dequeue(pf, q);
+    }
+
+    int res = hier_access(pf->hier, addr, write);
+    const int missed = !(res & CACHE_HIT);
+
+    if (res & CACHE_PREFETCHED)
+        pf->useful++;
+    if (missed && pf->filter[filter_slot(line)] == line + 1) {
+        pf->polluting++;
+        pf->filter[filter_slot(line)] = 0;
+    }
+    if (!missed && !(res & CACHE_PREFETCHED))
+        return res;
+
+    // train on misses and on first uses of prefetched lines
+    switch (pf->kind) {
+        case PF_NEXTLINE:
+            for (unsigned k = 0; k < pf->degree; k++)
+                issue(pf, line + pf->distance + k);
+            break;
+        case PF_STREAM: {
+            struct pf_stream* s = stream_train(pf, line);
+            if (s)
+                for (unsigned k = 0; k < pf->degree; k++)
+                    issue(pf, line + s->stride * (int64_t) (pf->distance + k));
+            break;
+        }
+        case PF_PAIR:
+            if (missed)
+                issue(pf, line ^ 1);
+            break;
+    }
+    return res;
+}
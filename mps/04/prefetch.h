@@ -0,0 +1,66 @@
+/*
+ * prefetch.h - Hardware prefetcher models in front of csim's L1
+ */
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <inttypes.h>
+
+#include "cache.h"
+
+enum pf_kind_t {
+    PF_NEXTLINE, // tagged next-line: misses and first uses of prefetches trigger
+    PF_STREAM,   // PC-less stride/stream detector over miss addresses
+    PF_PAIR,     // adjacent line: a miss fetches the other half of its pair
+};
+
+#define PF_STREAMS 16   // streams tracked at once
+#define PF_WINDOW 16    // lines a miss may be from a stream's last to join it
+#define PF_QUEUE 32     // prefetches in flight, more are dropped
+#define PF_FILTER 4096  // lines evicted by prefetches remembered, for pollution
+
+struct pf_stream {
+    uint64_t last;   // line of the latest miss in the stream
+    int64_t stride;  // in lines
+    int confidence;  // times stride was seen in a row
+    uint64_t stamp;  // last use, for replacement
+};
+
+struct prefetch_t {
+    enum pf_kind_t kind;
+    unsigned degree;   // lines prefetched per trigger
+    unsigned distance; // how far ahead, in strides, the first of them is
+    unsigned latency;  // accesses a prefetch takes to arrive
+    struct hier_t* hier;
+
+    struct pf_stream streams[PF_STREAMS];
+
+    // in flight, oldest first: line and the access it completes at
+    uint64_t queue_line[PF_QUEUE];
+    uint64_t queue_due[PF_QUEUE];
+    unsigned queue_head, queue_len;
+
+    uint64_t filter[PF_FILTER]; // line + 1, 0 for empty
+    uint64_t clock;             // demand accesses so far
+
+    uint64_t issued;    // prefetches sent to the hierarchy
+    uint64_t useful;    // prefetched lines a demand access then hit
+    uint64_t late;      // demand accesses to lines still in flight
+    uint64_t polluting; // demand misses to lines a prefetch evicted
+};
+
+/*
+ * prefetch_init - set up a prefetcher in front of hier's L1 from
+ *     kind[,degree[,distance[,latency]]], kind being next, stream or
+ *     pair. Returns 0, or -1 with a message on stderr.
+ */
+int prefetch_init(struct prefetch_t* pf, struct hier_t* hier, const char* spec);
+
+/*
+ * prefetch_access - make a demand access through hier as hier_access
+ *     does, completing prefetches that are due first and training and
+ *     issuing after. Returns as hier_access does.
+ */
+int prefetch_access(struct prefetch_t* pf, uint64_t addr, int write);
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * spsc.h - Bounded single producer, single consumer ring of uint64_t
+ *
+ * The producer only writes tail and the consumer only writes head, so
+ * the two sides need no lock, just acquire/release ordering on the
+ * index the other side owns. Each side caches the other's index and
+ * only reloads it when the ring looks full (or empty).
+ */
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#define SPSC_CACHE_LINE 64
+
+struct spsc_ring {
+    uint64_t* items;
+    size_t mask;
+
+    // consumer side
+    size_t head __attribute__((aligned(SPSC_CACHE_LINE)));
+    size_t tail_cache;
+
+    // producer side
+    size_t tail __attribute__((aligned(SPSC_CACHE_LINE)));
+    size_t head_cache;
+    int done; // producer has pushed everything
+};
+
+// capacity must be a power of 2
+static inline int spsc_init(struct spsc_ring* r, size_t capacity)
+{
+    r->items = (uint64_t*) malloc(capacity * sizeof(uint64_t));
+    r->mask = capacity - 1;
+    r->head = r->tail_cache = 0;
+    r->tail = r->head_cache = 0;
+    r->done = 0;
+    return r->items ? 0 : -1;
+}
+
+static inline void spsc_free(struct spsc_ring* r)
+{
+    free(r->items);
+}
+
+// producer: append up to n items, returns how many fit
+static inline size_t spsc_push(struct spsc_ring* r, const uint64_t* src, size_t n)
+{
+    const size_t tail = r->tail;
+    size_t room = r->mask + 1 - (tail - r->head_cache);
+
+    if (room < n) {
+        r->head_cache = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        room = r->mask + 1 - (tail - r->head_cache);
+    }
+    if (n > room)
+        n = room;
+    for (size_t i = 0; i < n; i++)
+        r->items[(tail + i) & r->mask] = src[i];
+    __atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+// producer: no more items will follow
+static inline void spsc_close(struct spsc_ring* r)
+{
+    __atomic_store_n(&r->done, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * consumer: take up to n items, returns how many. 0 with *closed set
+ *     means the ring is drained for good.
+ */
+static inline size_t spsc_pop(struct spsc_ring* r, uint64_t* dst, size_t n, int* closed)
+{
+    const size_t head = r->head;
+    size_t avail = r->tail_cache - head;
+
+    *closed = 0;
+    if (avail < n) {
+        // read done first, so a closed ring's last items are seen
+        *closed = __atomic_load_n(&r->done, __ATOMIC_ACQUIRE);
+        r->tail_cache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        avail = r->tail_cache - head;
+    }
+    if (n > avail)
+        n = avail;
+    for (size_t i = 0; i < n; i++)
+        dst[i] = r->items[(head + i) & r->mask];
+    __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+#endif
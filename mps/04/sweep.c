@@ -0,0 +1,175 @@
+/*
+ * sweep.c - LRU miss curves for many cache shapes at once
+ *
+ * In an LRU cache an access hits iff fewer than E other lines of its
+ * set were used since the last access to its line: its stack distance.
+ * So one histogram of stack distances gives the hits for every E.
+ *
+ * For each block and set size the accesses are stably sorted by set,
+ * which makes each set's accesses contiguous. Walking that order, a
+ * Fenwick tree marks the latest position of every line, and the stack
+ * distance of an access is the number of marks since its line's
+ * previous position, found with two prefix sums.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "sweep.h"
+
+// open addressing map from line number to its latest position
+struct last_use {
+    uint64_t* keys;
+    size_t* pos; // position + 1, 0 for an empty slot
+    size_t mask;
+};
+
+static int last_use_init(struct last_use* m, size_t n)
+{
+    size_t cap = 16;
+    while (cap < 2 * n)
+        cap <<= 1;
+    m->mask = cap - 1;
+    m->keys = (uint64_t*) malloc(cap * sizeof(uint64_t));
+    m->pos = (size_t*) malloc(cap * sizeof(size_t));
+    return m->keys && m->pos ? 0 : -1;
+}
+
+static void last_use_clear(struct last_use* m)
+{
+    memset(m->pos, 0, (m->mask + 1) * sizeof(size_t));
+}
+
+// slot for line, either holding it or empty
+static size_t* last_use_slot(struct last_use* m, uint64_t line)
+{
+    size_t h = (line * 0x9e3779b97f4a7c15ULL) >> 20 & m->mask;
+
+    while (m->pos[h] && m->keys[h] != line)
+        h = (h + 1) & m->mask;
+    m->keys[h] = line;
+    return &m->pos[h];
+}
+
+// Fenwick tree over positions 1..n
+static void fenwick_add(int32_t* tree, size_t n, size_t i, int32_t v)
+{
+    for (; i <= n; i += i & -i)
+        tree[i] += v;
+}
+
+static size_t fenwick_sum(const int32_t* tree, size_t i)
+{
+    size_t sum = 0;
+    for (; i; i -= i & -i)
+        sum += tree[i];
+    return sum;
+}
+
+/*
+ * sweep_sets - stack distance histogram for one block and set size.
+ *     hist[d] counts accesses at distance d < emax, and distinct[k]
+ *     counts sets that hold min(k, emax) distinct lines.
+ */
+static void sweep_sets(const uint64_t* lines, size_t n, int s, int emax,
+                       size_t* order, size_t* bucket, int32_t* tree,
+                       struct last_use* last, uint64_t* hist, uint64_t* distinct)
+{
+    const size_t nsets = (size_t) 1 << s;
+    const uint64_t set_mask = nsets - 1;
+
+    // counting sort by set, keeping trace order within a set
+    memset(bucket, 0, (nsets + 1) * sizeof(size_t));
+    for (size_t i = 0; i < n; i++)
+        bucket[(lines[i] & set_mask) + 1]++;
+    for (size_t k = 0; k < nsets; k++)
+        bucket[k + 1] += bucket[k];
+    for (size_t i = 0; i < n; i++)
+        order[bucket[lines[i] & set_mask]++] = i;
+
+    memset(tree, 0, (n + 1) * sizeof(int32_t));
+    last_use_clear(last);
+    memset(hist, 0, emax * sizeof(uint64_t));
+    memset(distinct, 0, (emax + 1) * sizeof(uint64_t));
+
+    size_t set_lines = 0;
+    uint64_t cur_set = n ? lines[order[0]] & set_mask : 0;
+
+    for (size_t p = 1; p <= n; p++) {
+        const uint64_t line = lines[order[p - 1]];
+
+        if ((line & set_mask) != cur_set) {
+            distinct[set_lines < (size_t) emax ? set_lines : (size_t) emax]++;
+            cur_set = line & set_mask;
+            set_lines = 0;
+        }
+
+        size_t* slot = last_use_slot(last, line);
+        if (*slot == 0) {
+            set_lines++;
+        } else {
+            const size_t d = fenwick_sum(tree, p - 1) - fenwick_sum(tree, *slot);
+            if (d < (size_t) emax)
+                hist[d]++;
+            fenwick_add(tree, n, *slot, -1);
+        }
+        fenwick_add(tree, n, p, 1);
+        *slot = p;
+    }
+    if (n)
+        distinct[set_lines < (size_t) emax ? set_lines : (size_t) emax]++;
+}
+
+int sweep_run(const uint64_t* addrs, size_t n, int bmin, int bmax,
+              int smax, int emax, FILE* out)
+{
+    uint64_t* lines = (uint64_t*) malloc(n * sizeof(uint64_t));
+    size_t* order = (size_t*) malloc(n * sizeof(size_t));
+    size_t* bucket = (size_t*) malloc((((size_t) 1 << smax) + 1) * sizeof(size_t));
+    int32_t* tree = (int32_t*) malloc((n + 1) * sizeof(int32_t));
+    uint64_t* hist = (uint64_t*) malloc(emax * sizeof(uint64_t));
+    uint64_t* distinct = (uint64_t*) malloc((emax + 1) * sizeof(uint64_t));
+    struct last_use last = { NULL, NULL, 0 };
+    int ret = -1;
+
+    if (!lines || !order || !bucket || !tree || !hist || !distinct
+        || last_use_init(&last, n) < 0)
+        goto done;
+
+    fprintf(out, "# b s E size accesses hits misses evictions miss_ratio\n");
+    for (int b = bmin; b <= bmax; b++) {
+        for (size_t i = 0; i < n; i++)
+            lines[i] = addrs[i] >> b;
+
+        for (int s = 0; s <= smax; s++) {
+            sweep_sets(lines, n, s, emax, order, bucket, tree, &last, hist, distinct);
+
+            uint64_t hits = 0;
+            for (int E = 1; E <= emax; E++) {
+                hits += hist[E - 1];
+
+                // lines never leave a set, so only the first E fills are free
+                uint64_t fills = 0;
+                for (int k = 1; k <= emax; k++)
+                    fills += distinct[k] * (k < E ? k : E);
+
+                const uint64_t misses = n - hits;
+                fprintf(out, "%d %d %d %" PRIu64 " %zu %" PRIu64 " %" PRIu64
+                        " %" PRIu64 " %.6f\n", b, s, E,
+                        ((uint64_t) E << (s + b)), n, hits, misses,
+                        misses - fills, n ? (double) misses / n : 0.0);
+            }
+        }
+    }
+    ret = 0;
+
+done:
+    free(lines);
+    free(order);
+    free(bucket);
+    free(tree);
+    free(hist);
+    free(distinct);
+    free(last.keys);
+    free(last.pos);
+    return ret;
+}
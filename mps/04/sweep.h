@@ -0,0 +1,23 @@
+/*
+ * sweep.h - LRU miss curves for many cache shapes at once
+ */
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * sweep_run - print hits/misses/evictions of an LRU cache for every
+ *     block size 2^b (bmin <= b <= bmax), every set count 2^s
+ *     (s <= smax) and every associativity E <= emax, given the n
+ *     addresses accessed in order. Uses per set LRU stack distances
+ *     (Mattson et al.), so every associativity comes from one pass, but
+ *     that is one pass over all n accesses per (b, s) pair: set counts
+ *     are not shared. Returns 0, or -1 if out of memory.
+ */
+int sweep_run(const uint64_t* addrs, size_t n, int bmin, int bmax,
+              int smax, int emax, FILE* out);
+
+#endif
@@ -0,0 +1,154 @@
+/*
+ * tlb.c - Two level data TLB model for csim, built from cache_t
+ *
+ * The walk cost is a rough count of cycles: every level of the page
+ * table is read at a fixed cost, as if no paging structure caches held
+ * any of it. It is meant for comparing page sizes, not predicting time.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "tlb.h"
+
+// sets bits for entries in ways, or -1 if the sets are not a power of 2
+static int set_bits(unsigned entries, unsigned ways)
+{
+    unsigned sets, bits = 0;
+
+    if (ways < 1 || entries % ways)
+        return -1;
+    sets = entries / ways;
+    if (sets < 1 || (sets & (sets - 1)))
+        return -1;
+    while (sets >>= 1)
+        bits++;
+    return bits;
+}
+
+#define TLB_USAGE "-T takes l1entries,l1ways[,l2entries,l2ways[,page[,cycles]]]\n"
+
+/*
+ * next_field - split the next comma separated field off *list, NULL when
+ *     there are no more. Empty fields come back as "", unlike strtok.
+ */
+static char* next_field(char** list)
+{
+    char* field = *list;
+
+    if (!field)
+        return NULL;
+    *list = strchr(field, ',');
+    if (*list)
+        *(*list)++ = '\0';
+    return field;
+}
+
+// parse all of field as an unsigned number, -1 if it is not one
+static int parse_number(const char* field, unsigned* value)
+{
+    char* end;
+    unsigned long v;
+
+    if (!*field || *field < '0' || *field > '9')
+        return -1;
+    v = strtoul(field, &end, 10);
+    if (*end || v > UINT32_MAX)
+        return -1;
+    *value = v;
+    return 0;
+}
+
+int tlb_init(struct tlb_t* tlb, const char* spec)
+{
+    unsigned l1e = 0, l1w = 0, l2e = 0, l2w = 0, cycles = 20;
+    unsigned* numbers[4] = { &l1e, &l1w, &l2e, &l2w };
+    const char* page = "4k";
+    char copy[128];
+    char* list = copy;
+    char* field;
+    int l1bits, l2bits = 0, n;
+
+    memset(tlb, 0, sizeof(*tlb));
+    if (strlen(spec) >= sizeof(copy)) {
+        fprintf(stderr, TLB_USAGE);
+        return -1;
+    }
+    strcpy(copy, spec);
+
+    // every field given must be there and parse; L2 needs both of its own
+    for (n = 0; (field = next_field(&list)); n++) {
+        int bad;
+        if (n < 4)
+            bad = parse_number(field, numbers[n]);
+        else if (n == 4)
+            bad = !*(page = field);
+        else if (n == 5)
+            bad = parse_number(field, &cycles);
+        else
+            bad = 1; // anything after cycles
+        if (bad) {
+            fprintf(stderr, TLB_USAGE);
+            return -1;
+        }
+    }
+    if (n < 2 || n == 3) {
+        fprintf(stderr, TLB_USAGE);
+        return -1;
+    }
+
+    if (strcmp(page, "4k") == 0 || strcmp(page, "4K") == 0) {
+        tlb->pagebits = 12;
+        tlb->walk_levels = 4;
+    } else if (strcmp(page, "2m") == 0 || strcmp(page, "2M") == 0) {
+        tlb->pagebits = 21;
+        tlb->walk_levels = 3;
+    } else {
+        fprintf(stderr, "-T page size must be 4k or 2m\n");
+        return -1;
+    }
+    tlb->walk_cycles = cycles;
+
+    l1bits = set_bits(l1e, l1w);
+    tlb->has_l2 = l2e > 0;
+    if (tlb->has_l2)
+        l2bits = set_bits(l2e, l2w);
+    if (l1bits < 0 || l2bits < 0) {
+        fprintf(stderr, "-T entries over ways must be a power of 2\n");
+        return -1;
+    }
+
+    if (cache_init(&tlb->l1, l1bits, l1w, tlb->pagebits, REPL_LRU) < 0)
+        return -1;
+    if (tlb->has_l2 && cache_init(&tlb->l2, l2bits, l2w, tlb->pagebits, REPL_LRU) < 0) {
+        cache_free(&tlb->l1);
+        return -1;
+    }
+    return 0;
+}
+
+void tlb_free(struct tlb_t* tlb)
+{
+    cache_free(&tlb->l1);
+    if (tlb->has_l2)
+        cache_free(&tlb->l2);
+}
+
+int tlb_access(struct tlb_t* tlb, uint64_t addr)
+{
+    if (cache_access(&tlb->l1, addr, 0) & CACHE_HIT)
+        return 0;
+    if (tlb->has_l2 && (cache_access(&tlb->l2, addr, 0) & CACHE_HIT))
+        return 0;
+    tlb->walks++;
+    return 1;
+}
+
+void tlb_print(struct tlb_t* tlb, FILE* out)
+{
+    fprintf(out, "TLB %s pages: L1 hits:%" PRIu64 " misses:%" PRIu64,
+            tlb->pagebits == 12 ? "4K" : "2M", tlb->l1.hits, tlb->l1.misses);
+    if (tlb->has_l2)
+        fprintf(out, " L2 hits:%" PRIu64 " misses:%" PRIu64, tlb->l2.hits, tlb->l2.misses);
+    fprintf(out, " walks:%" PRIu64 " walk cycles:%" PRIu64 "\n", tlb->walks,
+            tlb->walks * tlb->walk_levels * tlb->walk_cycles);
+}
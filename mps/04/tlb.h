@@ -0,0 +1,43 @@
+/*
+ * tlb.h - Two level data TLB model for csim, built from cache_t
+ */
+#ifndef TLB_H
+#define TLB_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "cache.h"
+
+/*
+ * Each TLB level is an LRU cache_t whose "lines" are pages, so b is the
+ * page bits. An L1 miss looks in L2 (if any), and a miss there walks
+ * the page table.
+ */
+struct tlb_t {
+    struct cache_t l1, l2;
+    int has_l2;
+    unsigned pagebits;    // 12 for 4K pages, 21 for 2M
+    unsigned walk_levels; // page table levels a walk reads, 4 or 3 on x86-64
+    unsigned walk_cycles; // assumed cost of reading one of them
+    uint64_t walks;
+};
+
+/*
+ * tlb_init - set up a TLB from
+ *     l1entries,l1ways[,l2entries,l2ways[,page[,cycles]]], page being
+ *     4k (default) or 2m and cycles per page table level read (default
+ *     20). l2entries of 0 leaves out L2. Returns 0, or -1 with a message
+ *     on stderr.
+ */
+int tlb_init(struct tlb_t* tlb, const char* spec);
+
+void tlb_free(struct tlb_t* tlb);
+
+// translate addr; returns 1 if it took a page walk
+int tlb_access(struct tlb_t* tlb, uint64_t addr);
+
+// print per level hits and misses, walks and their approximate cost
+void tlb_print(struct tlb_t* tlb, FILE* out);
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * tpool.c - Fixed pool of pinned threads with work stealing task ranges
+ *
+ * Jobs are started and waited for under one mutex; that costs a few
+ * microseconds, against jobs that are whole matrix transposes. The task
+ * ranges themselves are lock free.
+ */
+#define _GNU_SOURCE // pthread_setaffinity_np, CPU_SET
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tpool.h"
+
+#define RANGE(next, end) ((uint64_t) (next) << 32 | (end))
+#define NEXT(r) ((uint32_t) ((r) >> 32))
+#define END(r) ((uint32_t) (r))
+
+/*
+ * pin - pin the calling thread to the id-th CPU the pool's caller was
+ *     allowed on. Threads start with the mask of whoever created them,
+ *     which for the workers is the caller already pinned to one CPU, so
+ *     it is the caller's saved mask that counts.
+ */
+static void pin(struct tpool* pool, int id)
+{
+    cpu_set_t allowed, one;
+    int n, cpu;
+
+    if (pool->caller_cpus)
+        allowed = *(cpu_set_t*) pool->caller_cpus;
+    else if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+    n = CPU_COUNT(&allowed);
+    if (n < 1)
+        return;
+    id %= n;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &allowed) && id-- == 0)
+            break;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+}
+
+static void* thread_main(void* arg)
+{
+    struct tpool_thread* t = (struct tpool_thread*) arg;
+    struct tpool* pool = t->pool;
+    uint64_t seen = 0;
+
+    pin(pool, t->id);
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->stop)
+            pthread_cond_wait(&pool->go, &pool->lock);
+        if (pool->stop) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        seen = pool->generation;
+        tpool_job job = pool->job;
+        void* job_arg = pool->arg;
+        pthread_mutex_unlock(&pool->lock);
+
+        job(pool, t->id, job_arg);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0)
+            pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+int tpool_start(struct tpool* pool, int nthreads)
+{
+    if (nthreads < 1 || nthreads > TPOOL_MAX_THREADS)
+        return -1;
+    pool->nthreads = nthreads;
+    pool->generation = 0;
+    pool->running = 0;
+    pool->stop = 0;
+    // calloc only promises 16 byte alignment, not the 64 keeping each
+    // thread's range on a line of its own
+    void* threads;
+    if (posix_memalign(&threads, 64, nthreads * sizeof(struct tpool_thread)) != 0)
+        threads = NULL;
+    pool->threads = (struct tpool_thread*) threads;
+    pool->caller_cpus = malloc(sizeof(cpu_set_t));
+    if (!pool->threads || !pool->caller_cpus) {
+        free(pool->threads);
+        free(pool->caller_cpus);
+        return -1;
+    }
+    memset(pool->threads, 0, nthreads * sizeof(struct tpool_thread));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->go, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+        pool->threads[i].pool = pool;
+        pool->threads[i].id = i;
+    }
+    // pinning the caller lasts only as long as the pool
+    if (sched_getaffinity(0, sizeof(cpu_set_t), (cpu_set_t*) pool->caller_cpus) != 0) {
+        free(pool->caller_cpus);
+        pool->caller_cpus = NULL;
+    }
+    pin(pool, 0);
+    for (int i = 1; i < nthreads; i++)
+        if (pthread_create(&pool->threads[i].thread, NULL, thread_main, &pool->threads[i]) != 0) {
+            pool->nthreads = i;
+            tpool_stop(pool);
+            return -1;
+        }
+    return 0;
+}
+
+void tpool_stop(struct tpool* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->go);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 1; i < pool->nthreads; i++)
+        pthread_join(pool->threads[i].thread, NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->go);
+    pthread_cond_destroy(&pool->done);
+    if (pool->caller_cpus) {
+        sched_setaffinity(0, sizeof(cpu_set_t), (cpu_set_t*) pool->caller_cpus);
+        free(pool->caller_cpus);
+    }
+    free(pool->threads);
+}
+
+void tpool_run(struct tpool* pool, tpool_job job, void* arg)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->arg = arg;
+    pool->running = pool->nthreads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->go);
+    pthread_mutex_unlock(&pool->lock);
+
+    job(pool, 0, arg);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void tpool_share(const struct tpool* pool, int id, uint32_t ntasks,
+                 uint32_t* first, uint32_t* end)
+{
+    *first = (uint64_t) ntasks * id / pool->nthreads;
+    *end = (uint64_t) ntasks * (id + 1) / pool->nthreads;
+}
+
+void tpool_split(struct tpool* pool, uint32_t ntasks)
+{
+    for (int i = 0; i < pool->nthreads; i++) {
+        uint32_t first, end;
+        tpool_share(pool, i, ntasks, &first, &end);
+        __atomic_store_n(&pool->threads[i].range, RANGE(first, end), __ATOMIC_RELAXED);
+    }
+}
+
+int tpool_next(struct tpool* pool, int id, uint32_t* task)
+{
+    struct tpool_thread* self = &pool->threads[id];
+    uint64_t r = __atomic_load_n(&self->range, __ATOMIC_ACQUIRE);
+
+    // own range, front first
+    while (NEXT(r) < END(r)) {
+        if (__atomic_compare_exchange_n(&self->range, &r, RANGE(NEXT(r) + 1, END(r)), 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *task = NEXT(r);
+            return 1;
+        }
+    }
+
+    // steal the back half of the first non-empty range after ours
+    for (int k = 1; k < pool->nthreads; k++) {
+        struct tpool_thread* victim = &pool->threads[(id + k) % pool->nthreads];
+        uint64_t v = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+
+        while (NEXT(v) < END(v)) {
+            uint32_t mid = NEXT(v) + (END(v) - NEXT(v)) / 2;
+            if (__atomic_compare_exchange_n(&victim->range, &v, RANGE(NEXT(v), mid), 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                // run mid now, keep the rest for ourselves (and other thieves)
+                __atomic_store_n(&self->range, RANGE(mid + 1, END(v)), __ATOMIC_RELEASE);
+                self->steals++;
+                *task = mid;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * tpool.h - Fixed pool of pinned threads with work stealing task ranges
+ */
+#ifndef TPOOL_H
+#define TPOOL_H
+
+#include <inttypes.h>
+#include <pthread.h>
+
+#define TPOOL_MAX_THREADS 256
+
+/*
+ * Each thread owns a range of task numbers, packed as next << 32 | end
+ * so it can be updated with one compare and swap. The owner takes tasks
+ * from the front; a thread whose range has run dry steals the back half
+ * of someone else's.
+ */
+struct tpool_thread {
+    pthread_t thread;
+    uint64_t range;
+    uint64_t steals;
+    struct tpool* pool;
+    int id;
+} __attribute__((aligned(64)));
+
+typedef void (*tpool_job)(struct tpool* pool, int id, void* arg);
+
+struct tpool {
+    int nthreads; // including the caller, which is thread 0
+    struct tpool_thread* threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t go;
+    pthread_cond_t done;
+    uint64_t generation; // bumped for every job
+    int running;         // threads still in the current job
+    int stop;
+    tpool_job job;
+    void* arg;
+    void* caller_cpus; // the caller's cpu_set_t from before it was pinned
+};
+
+/*
+ * tpool_start - start nthreads - 1 threads; the caller is the last one.
+ *     Thread i is pinned to the i-th CPU the process may run on, modulo
+ *     how many there are, so pages it touches first stay local to it.
+ *     Returns 0 or -1.
+ */
+int tpool_start(struct tpool* pool, int nthreads);
+
+// stop and join the threads, and give the caller back its CPU affinity
+void tpool_stop(struct tpool* pool);
+
+// run job(pool, id, arg) on every thread, the caller as id 0, and wait for all
+void tpool_run(struct tpool* pool, tpool_job job, void* arg);
+
+/*
+ * tpool_split - hand tasks 0..ntasks-1 out in contiguous ranges, thread
+ *     id getting the id-th. The same ntasks always splits the same way.
+ *     Call before tpool_run.
+ */
+void tpool_split(struct tpool* pool, uint32_t ntasks);
+
+// first and one past the last task tpool_split gives thread id
+void tpool_share(const struct tpool* pool, int id, uint32_t ntasks,
+                 uint32_t* first, uint32_t* end);
+
+/*
+ * tpool_next - from within a job: the next task for thread id, its own
+ *     or stolen. Returns 1, or 0 once every range is empty.
+ */
+int tpool_next(struct tpool* pool, int id, uint32_t* task);
+
+#endif
@@ -0,0 +1,442 @@
+/*
+ * trace.c - Fast reader for valgrind lackey traces
+ *
+ * Regular files are mmapped and parsed in place, no copies and no
+ * stdio. Newlines are found 64 bytes at a time with SSE2, or AVX2 when
+ * the CPU has it, and the address is accumulated through a hex digit
+ * table, which also stops it at the ',' before the size. Anything that
+ * cannot be mmapped (stdin, pipes) is read() into a large buffer with
+ * the partial last line carried over between refills.
+ *
+ * Binary traces (see trace.h) are recognised by their magic and decoded
+ * a block at a time out of the same window.
+ */
+#define _GNU_SOURCE // F_SETPIPE_SZ
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include "trace.h"
+
+// streaming buffer size, and the most a refill reads at once
+#define STREAM_BUF (1 << 20)
+
+// ask for pipes this big, so a writer like valgrind can run further ahead
+#define PIPE_SIZE (1 << 20)
+
+// value of each hex digit, -1 for anything else
+static signed char hex_digit[256];
+
+static void init_hex_digits(void)
+{
+    memset(hex_digit, -1, sizeof(hex_digit));
+    for (int i = 0; i < 10; i++)
+        hex_digit['0' + i] = i;
+    for (int i = 0; i < 6; i++)
+        hex_digit['a' + i] = hex_digit['A' + i] = 10 + i;
+}
+
+/*
+ * Newline scanners: a bit mask of the '\n's in the 64 bytes at p. One
+ * block covers several lackey lines (about 16 bytes each), so
+ * trace_next takes lines from the mask until it runs dry.
+ */
+
+__attribute__((target("sse2")))
+static uint64_t scan_sse2(const char* p)
+{
+    const __m128i nl = _mm_set1_epi8('\n');
+    uint64_t mask = 0;
+
+    for (int i = 0; i < 4; i++) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (p + 16 * i));
+        mask |= (uint64_t) (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) << (16 * i);
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t scan_avx2(const char* p)
+{
+    const __m256i nl = _mm256_set1_epi8('\n');
+    __m256i lo = _mm256_loadu_si256((const __m256i*) p);
+    __m256i hi = _mm256_loadu_si256((const __m256i*) (p + 32));
+
+    return (uint64_t) (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, nl))
+        | (uint64_t) (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, nl)) << 32;
+}
+
+// NULL: plain memchr per line
+static uint64_t (*scan_block)(const char*) = NULL;
+static int scan_chosen = 0;
+
+int trace_set_scan(enum trace_scan_t scan)
+{
+    scan_chosen = 1;
+    switch (scan) {
+        case TRACE_SCAN_SCALAR:
+            scan_block = NULL;
+            return 0;
+        case TRACE_SCAN_SSE2:
+            scan_block = scan_sse2;
+            return 0;
+        case TRACE_SCAN_AVX2:
+            __builtin_cpu_init();
+            if (!__builtin_cpu_supports("avx2"))
+                return -1;
+            scan_block = scan_avx2;
+            return 0;
+    }
+    return -1;
+}
+
+/*
+ * next_newline - first '\n' at or after line, or end. Lines are taken in
+ *     order, so every newline in tr->blk before the ones left in
+ *     tr->nl_mask has already been handed out.
+ */
+static const char* next_newline(struct trace_reader* tr, const char* line, const char* end)
+{
+    for (;;) {
+        if (tr->nl_mask) {
+            const char* nl = tr->blk + __builtin_ctzll(tr->nl_mask);
+            tr->nl_mask &= tr->nl_mask - 1;
+            return nl;
+        }
+
+        const char* next = tr->blk ? tr->blk + 64 : line;
+        if (!scan_block || next + 64 > end) {
+            // near the end of the data, or no vector scanner
+            tr->blk = NULL;
+            const char* nl = (const char*) memchr(line, '\n', end - line);
+            return nl ? nl : end;
+        }
+        tr->blk = next;
+        tr->nl_mask = scan_block(next);
+    }
+}
+
+/*
+ * refill - move the unparsed tail of the buffer to its front and read
+ *     more after it. Returns 0 once nothing more will come.
+ */
+static int refill(struct trace_reader* tr)
+{
+    if (tr->eof)
+        return 0;
+
+    size_t keep = tr->len - tr->pos;
+    memmove(tr->buf, tr->buf + tr->pos, keep);
+    tr->pos = 0;
+    tr->len = keep;
+    // the data moves, rescan from the start of the partial line
+    tr->blk = NULL;
+    tr->nl_mask = 0;
+
+    // a line longer than the buffer: grow it
+    if (keep == tr->cap) {
+        char* bigger = (char*) realloc(tr->buf, tr->cap * 2);
+        if (!bigger) {
+            tr->eof = tr->error = 1;
+            return 0;
+        }
+        tr->buf = bigger;
+        tr->cap *= 2;
+    }
+
+    for (;;) {
+        ssize_t n = read(tr->fd, tr->buf + tr->len, tr->cap - tr->len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            tr->eof = 1;
+        else
+            tr->len += n;
+        break;
+    }
+    tr->data = tr->buf;
+    return 1;
+}
+
+// skip the header of a binary trace
+static void detect_binary(struct trace_reader* tr)
+{
+    if (tr->len - tr->pos >= TRACE_MAGIC_LEN
+        && memcmp(tr->data + tr->pos, TRACE_MAGIC, TRACE_MAGIC_LEN) == 0) {
+        tr->binary = 1;
+        tr->pos += TRACE_MAGIC_LEN;
+    }
+}
+
+int trace_open(struct trace_reader* tr, const char* path)
+{
+    struct stat st;
+
+    memset(tr, 0, sizeof(*tr));
+    if (hex_digit[0] == 0)
+        init_hex_digits();
+    if (!scan_chosen && trace_set_scan(TRACE_SCAN_AVX2) < 0)
+        trace_set_scan(TRACE_SCAN_SSE2);
+
+    if (strcmp(path, "-") == 0)
+        tr->fd = STDIN_FILENO;
+    else if ((tr->fd = open(path, O_RDONLY)) < 0)
+        return -1;
+
+    // map regular files whole
+    if (fstat(tr->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, tr->fd, 0);
+        if (m != MAP_FAILED) {
+            madvise(m, st.st_size, MADV_SEQUENTIAL);
+            tr->mapped = 1;
+            tr->data = (const char*) m;
+            tr->len = st.st_size;
+            tr->eof = 1;
+            detect_binary(tr);
+            return 0;
+        }
+    }
+
+    // stream everything else
+#ifdef F_SETPIPE_SZ
+    if (fstat(tr->fd, &st) == 0 && S_ISFIFO(st.st_mode))
+        fcntl(tr->fd, F_SETPIPE_SZ, PIPE_SIZE); // only a hint, may fail
+#endif
+    tr->cap = STREAM_BUF;
+    tr->buf = (char*) malloc(tr->cap);
+    if (!tr->buf) {
+        trace_close(tr);
+        errno = ENOMEM;
+        return -1;
+    }
+    tr->data = tr->buf;
+    while (tr->len < TRACE_MAGIC_LEN && refill(tr))
+        ;
+    detect_binary(tr);
+    return 0;
+}
+
+/*
+ * get_varint - decode a LEB128 varint from [*p, end). Returns 0 if it
+ *     runs off the end.
+ */
+static int get_varint(const uint8_t** p, const uint8_t* end, uint64_t* v)
+{
+    uint64_t x = 0;
+
+    for (unsigned shift = 0; *p < end && shift < 64; shift += 7) {
+        uint8_t byte = *(*p)++;
+        x |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *v = x;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static const char binary_ops[4] = { VG_DATA_LOAD, VG_DATA_STORE, VG_DATA_MOD, VG_INSTR_LOAD };
+
+static int next_binary(struct trace_reader* tr, struct vg_acc_t* acc)
+{
+    for (;;) {
+        const uint8_t* p = (const uint8_t*) tr->data + tr->pos;
+
+        if (tr->rec_left) {
+            const uint8_t* end = (const uint8_t*) tr->data + tr->blk_end;
+            uint64_t head, delta, thread = tr->prev_thread;
+
+            if (!get_varint(&p, end, &head) || !get_varint(&p, end, &delta)
+                || ((head & 4) && !get_varint(&p, end, &thread))) {
+                tr->error = 1; // corrupt block
+                return 0;
+            }
+            tr->pos = p - (const uint8_t*) tr->data;
+            tr->rec_left--;
+            tr->prev_addr += (delta >> 1) ^ -(delta & 1);
+            tr->prev_thread = thread;
+
+            if ((head & 3) == 3 && !tr->instructions)
+                continue;
+            acc->operator = binary_ops[head & 3];
+            acc->address = tr->prev_addr;
+            acc->size = head >> 3;
+            acc->thread = tr->prev_thread;
+            return 1;
+        }
+
+        // next block, once its header and all of its records are here
+        const uint8_t* end = (const uint8_t*) tr->data + tr->len;
+        uint64_t records, bytes;
+        if (!get_varint(&p, end, &records) || !get_varint(&p, end, &bytes)
+            || bytes > (uint64_t) (end - p)) {
+            if (refill(tr))
+                continue;
+            // anything left is a block cut short
+            if (tr->pos < tr->len)
+                tr->error = 1;
+            return 0;
+        }
+        tr->pos = p - (const uint8_t*) tr->data;
+        tr->blk_end = tr->pos + bytes;
+        tr->rec_left = records;
+        tr->prev_addr = 0;
+        tr->prev_thread = 0;
+    }
+}
+
+int trace_next(struct trace_reader* tr, struct vg_acc_t* acc)
+{
+    if (tr->binary)
+        return next_binary(tr, acc);
+
+    for (;;) {
+        const char* line = tr->data + tr->pos;
+        const char* end = tr->data + tr->len;
+        const char* nl = next_newline(tr, line, end);
+
+        // partial line: read more unless that was the last of it
+        if (nl == end && !tr->eof) {
+            if (!refill(tr) && tr->error)
+                return 0;
+            continue;
+        }
+        if (line == end)
+            return 0;
+        tr->pos = nl - tr->data + (nl < end);
+
+        // T<n> in front says which thread made the access
+        unsigned thread = 0;
+        if (line[0] == 'T')
+            for (line++; line < nl && *line >= '0' && *line <= '9'; line++)
+                thread = thread * 10 + (*line - '0');
+        acc->thread = thread;
+
+        // ignore comments, instruction fetches and anything too short
+        if (nl - line < 4)
+            continue;
+        if (line[0] == 'I' && tr->instructions)
+            acc->operator = VG_INSTR_LOAD;
+        else if (line[0] == ' ')
+            acc->operator = line[1];
+        else
+            continue;
+
+        const char* p = line + 3;
+        while (p < nl && *p == ' ')
+            p++;
+
+        // read address, stopping at the ','
+        uint64_t addr = 0;
+        int d;
+        while (p < nl && (d = hex_digit[(unsigned char) *p]) >= 0) {
+            addr = addr << 4 | d;
+            p++;
+        }
+        acc->address = addr;
+
+        // read size
+        unsigned size = 0;
+        if (p < nl && *p == ',')
+            for (p++; p < nl && *p >= '0' && *p <= '9'; p++)
+                size = size * 10 + (*p - '0');
+        acc->size = size;
+        return 1;
+    }
+}
+
+void trace_close(struct trace_reader* tr)
+{
+    if (tr->mapped)
+        munmap((void*) tr->data, tr->len);
+    free(tr->buf);
+    if (tr->fd > STDIN_FILENO)
+        close(tr->fd);
+    tr->data = NULL;
+    tr->buf = NULL;
+}
+
+/*
+ * Binary writer
+ */
+
+static size_t put_varint(uint8_t* p, uint64_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = (uint8_t) v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = (uint8_t) v;
+    return n;
+}
+
+static int flush_block(struct trace_writer* tw)
+{
+    uint8_t head[20];
+    size_t n;
+
+    if (!tw->records)
+        return 0;
+    n = put_varint(head, tw->records);
+    n += put_varint(head + n, tw->len);
+    if (fwrite(head, 1, n, tw->out) != n
+        || fwrite(tw->buf, 1, tw->len, tw->out) != tw->len)
+        return -1;
+    tw->records = tw->len = 0;
+    tw->prev_addr = 0;
+    tw->prev_thread = 0;
+    return 0;
+}
+
+int trace_writer_open(struct trace_writer* tw, FILE* out)
+{
+    tw->out = out;
+    tw->records = tw->len = 0;
+    tw->prev_addr = 0;
+    tw->prev_thread = 0;
+    return fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LEN, out) == TRACE_MAGIC_LEN ? 0 : -1;
+}
+
+int trace_write(struct trace_writer* tw, const struct vg_acc_t* acc)
+{
+    unsigned op;
+
+    switch (acc->operator) {
+        case VG_DATA_LOAD:  op = 0; break;
+        case VG_DATA_STORE: op = 1; break;
+        case VG_DATA_MOD:   op = 2; break;
+        default:            op = 3; break;
+    }
+
+    // three varints take at most 30 bytes
+    if (tw->len + 30 > TRACE_BLOCK_MAX && flush_block(tw) < 0)
+        return -1;
+
+    const uint64_t delta = acc->address - tw->prev_addr;
+    const int change = acc->thread != tw->prev_thread;
+    tw->len += put_varint(tw->buf + tw->len, (uint64_t) acc->size << 3 | change << 2 | op);
+    tw->len += put_varint(tw->buf + tw->len, delta << 1 ^ -(delta >> 63));
+    if (change)
+        tw->len += put_varint(tw->buf + tw->len, acc->thread);
+    tw->prev_addr = acc->address;
+    tw->prev_thread = acc->thread;
+    tw->records++;
+    return 0;
+}
+
+int trace_writer_close(struct trace_writer* tw)
+{
+    if (flush_block(tw) < 0 || fflush(tw->out) != 0)
+        return -1;
+    return 0;
+}
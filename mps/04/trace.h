@@ -0,0 +1,118 @@
+/*
+ * trace.h - Fast reader for valgrind lackey traces
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// parsed valgrind line
+struct vg_acc_t {
+
+    // request type
+    enum vg_acc_type_t {
+        VG_INSTR_LOAD = 'I',
+        VG_DATA_LOAD  = 'L',
+        VG_DATA_STORE = 'S',
+        VG_DATA_MOD   = 'M',
+    } operator;
+    // address
+    uint64_t address;
+    // number of bytes
+    unsigned char size;
+    // n of a T<n> tag in front of the line, the thread that made the
+    // access; 0 if untagged
+    unsigned short thread;
+};
+
+/*
+ * Binary traces start with TRACE_MAGIC and then hold blocks of
+ *
+ *     varint records, varint bytes, then bytes of records
+ *
+ * Each record is a varint size << 3 | switch << 2 | op (0 L, 1 S, 2 M,
+ * 3 I) followed by the zigzag varint difference between its address and
+ * the previous record's, and if switch is set a varint thread: records
+ * are by the previous record's thread unless they switch. The previous
+ * address and thread are 0 at the start of every block, so blocks decode
+ * on their own. Varints are LEB128: 7 bits per byte, low
+ * bits first, top bit set on all but the last byte.
+ */
+#define TRACE_MAGIC "CSIMTRC1"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_BLOCK_MAX (64 * 1024)
+
+/*
+ * The reader parses out of one window of data: the whole file when it
+ * could be mmapped, else a buffer refilled by read() (stdin, pipes).
+ */
+struct trace_reader {
+    int fd;
+    int mapped;      // data is an mmap of the whole file
+    const char* data;
+    size_t len;      // bytes of data that are valid
+    size_t pos;      // next unparsed byte
+    char* buf;       // streaming buffer
+    size_t cap;
+    int eof;         // read() has returned 0
+    int error;       // gave up: out of memory for a line (eof is set too),
+                     // or a corrupt or truncated binary trace
+    const char* blk; // 64 byte block the newline scan is in
+    uint64_t nl_mask;// newlines in blk not yet reached
+
+    int instructions; // set to get I records too, not just data accesses
+    int binary;       // TRACE_MAGIC was found
+    size_t rec_left;  // records left in the current binary block
+    size_t blk_end;   // offset in data where that block ends
+    uint64_t prev_addr;
+    unsigned short prev_thread;
+};
+
+/*
+ * trace_open - open a text or binary trace, "-" meaning stdin. Returns
+ *     0, or -1 with errno set.
+ */
+int trace_open(struct trace_reader* tr, const char* path);
+
+/*
+ * trace_next - parse the next data access (instruction fetches and
+ *     comments are skipped). Text lines may be tagged with the thread
+ *     that made them, as in "T1 L 7ff000,4". Returns 1, or 0 at the end
+ *     of the trace or on an error, which sets tr->error.
+ */
+int trace_next(struct trace_reader* tr, struct vg_acc_t* acc);
+
+void trace_close(struct trace_reader* tr);
+
+// binary trace output, buffered a block at a time
+struct trace_writer {
+    FILE* out;
+    size_t records;
+    size_t len;
+    uint64_t prev_addr;
+    unsigned short prev_thread;
+    uint8_t buf[TRACE_BLOCK_MAX];
+};
+
+// start a binary trace on out. Returns 0, or -1 if writing failed.
+int trace_writer_open(struct trace_writer* tw, FILE* out);
+
+// append one record. Returns 0, or -1 if writing failed.
+int trace_write(struct trace_writer* tw, const struct vg_acc_t* acc);
+
+// write out the last block; out stays open. Returns 0 or -1.
+int trace_writer_close(struct trace_writer* tw);
+
+// newline scanners trace_next can use, the widest the CPU has by default
+enum trace_scan_t {
+    TRACE_SCAN_SCALAR,
+    TRACE_SCAN_SSE2,
+    TRACE_SCAN_AVX2,
+};
+
+// force a scanner, for benchmarking. Returns -1 if the CPU lacks it.
+int trace_set_scan(enum trace_scan_t scan);
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ * tracebench.c - Trace parsing throughput, old stdio path vs trace.c
+ *
+ * Usage: ./tracebench [-r <repeats>] [-b <binary trace>] <tracefile>
+ *
+ * Parses the whole trace repeats times with each reader and prints the
+ * best time, MB/s and million accesses/s. The address sum is printed
+ * too, so every reader can be seen to agree. With -b the same trace
+ * converted by tracecvt is decoded too; its MB/s are of the text size,
+ * so all rows compare.
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "trace.h"
+#include "util.h"
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// result of one pass over the trace
+struct pass {
+    size_t accesses;
+    uint64_t addr_sum;
+};
+
+/*
+ * pass_getline - what csim did before trace.c: getline from util.h
+ *     (fgetc per character) and a table driven hex parse
+ */
+static struct pass pass_getline(const char* path)
+{
+    static signed char hex[256];
+    struct pass r = { 0, 0 };
+    size_t line_len = 150;
+    char* line = (char*) calloc(sizeof(char), line_len);
+    FILE* f = fopen(path, "r");
+
+    if (!f || !line) {
+        perror(path);
+        exit(1);
+    }
+    memset(hex, -1, sizeof(hex));
+    for (int i = 0; i < 10; i++)
+        hex['0' + i] = i;
+    for (int i = 0; i < 6; i++)
+        hex['a' + i] = hex['A' + i] = 10 + i;
+
+    while (getline(&line, &line_len, f) >= 0) {
+        if (line[0] != ' ')
+            continue;
+        char* p = line + 3;
+        uint64_t addr = 0;
+        int d;
+        while ((d = hex[(unsigned char) *p]) >= 0) {
+            addr = addr << 4 | d;
+            p++;
+        }
+        if (*p == ',')
+            p++;
+        r.addr_sum += addr + atoi(p);
+        r.accesses++;
+    }
+    free(line);
+    fclose(f);
+    return r;
+}
+
+static struct pass pass_reader(const char* path)
+{
+    struct pass r = { 0, 0 };
+    struct trace_reader tr;
+    struct vg_acc_t acc;
+
+    if (trace_open(&tr, path) < 0) {
+        perror(path);
+        exit(1);
+    }
+    while (trace_next(&tr, &acc)) {
+        r.addr_sum += acc.address + acc.size;
+        r.accesses++;
+    }
+    trace_close(&tr);
+    return r;
+}
+
+static void bench(const char* name, struct pass (*fn)(const char*),
+                  const char* path, int repeats, double bytes)
+{
+    double best = 1e30;
+    struct pass r = { 0, 0 };
+
+    for (int i = 0; i < repeats; i++) {
+        double t = now();
+        r = fn(path);
+        t = now() - t;
+        if (t < best)
+            best = t;
+    }
+    printf("%-14s %8.2f ms %9.1f MB/s %8.1f Macc/s  (%zu accesses, sum %" PRIx64 ")\n",
+           name, best * 1e3, bytes / best / 1e6, r.accesses / best / 1e6,
+           r.accesses, r.addr_sum);
+}
+
+int main(int argc, char** argv)
+{
+    int c, repeats = 5;
+    const char* binary = NULL;
+    struct stat st;
+
+    while ((c = getopt(argc, argv, "r:b:")) != -1) {
+        switch (c) {
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            case 'b':
+                binary = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r <repeats>] [-b <binary trace>] <tracefile>\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind >= argc || stat(argv[optind], &st) < 0) {
+        fprintf(stderr, "Usage: %s [-r <repeats>] [-b <binary trace>] <tracefile>\n", argv[0]);
+        return 1;
+    }
+    const char* path = argv[optind];
+    const double bytes = st.st_size;
+
+    bench("getline", pass_getline, path, repeats, bytes);
+
+    trace_set_scan(TRACE_SCAN_SCALAR);
+    bench("mmap memchr", pass_reader, path, repeats, bytes);
+    trace_set_scan(TRACE_SCAN_SSE2);
+    bench("mmap sse2", pass_reader, path, repeats, bytes);
+    if (trace_set_scan(TRACE_SCAN_AVX2) == 0)
+        bench("mmap avx2", pass_reader, path, repeats, bytes);
+    else
+        printf("mmap avx2      (not supported by this CPU)\n");
+    if (binary)
+        bench("binary", pass_reader, binary, repeats, bytes);
+    return 0;
+}
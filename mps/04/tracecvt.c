@@ -0,0 +1,97 @@
+/*
+ * tracecvt.c - Convert valgrind lackey traces to and from csim's binary
+ *     trace format (described in trace.h)
+ *
+ * Usage: ./tracecvt [-ht] <in> <out>
+ *
+ * The input may be either format and "-" means stdin/stdout. Output is
+ * binary unless -t asks for text. Instruction fetches and T<n> thread
+ * tags are kept, comments are dropped, and text output writes addresses
+ * without leading zeros and tags only for threads other than 0.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <inttypes.h>
+
+#include "trace.h"
+
+static struct trace_writer writer;
+
+static void usage(char* argv0)
+{
+    printf("Usage: %s [-ht] <in> <out>\n"
+           "\t-h: Print this message\n"
+           "\t-t: Write a text trace (default: binary)\n"
+           "\t<in>, <out>: Trace files, - for stdin/stdout\n", argv0);
+}
+
+int main(int argc, char** argv)
+{
+    int c, text = 0;
+
+    while ((c = getopt(argc, argv, "ht")) != -1) {
+        switch (c) {
+            case 't':
+                text = 1;
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct trace_reader tr;
+    if (trace_open(&tr, argv[optind]) < 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    tr.instructions = 1;
+
+    const char* out_path = argv[optind + 1];
+    FILE* out = strcmp(out_path, "-") == 0 ? stdout : fopen(out_path, "wb");
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+
+    int err = 0;
+    struct vg_acc_t acc;
+    if (text) {
+        while (trace_next(&tr, &acc) && !err) {
+            if (acc.thread && fprintf(out, "T%u", acc.thread) < 0)
+                err = 1;
+            else if (acc.operator == VG_INSTR_LOAD)
+                err = fprintf(out, "I  %" PRIx64 ",%d\n", acc.address, acc.size) < 0;
+            else
+                err = fprintf(out, " %c %" PRIx64 ",%d\n", acc.operator,
+                              acc.address, acc.size) < 0;
+        }
+    } else {
+        err = trace_writer_open(&writer, out) < 0;
+        while (!err && trace_next(&tr, &acc))
+            err = trace_write(&writer, &acc) < 0;
+        err = err || trace_writer_close(&writer) < 0;
+    }
+
+    if (fflush(out) != 0)
+        err = 1;
+    if (err)
+        perror(out_path);
+    if (tr.error) {
+        fprintf(stderr, "could not read all of %s\n", argv[optind]);
+        err = 1;
+    }
+    if (out != stdout)
+        fclose(out);
+    trace_close(&tr);
+    return err;
+}
@@ -25,20 +25,23 @@ extern void registerFunctions();
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
 
-static int A[256][256];
-static int B[256][256];
+/* Up to 256x256 the matrices are static, as they always were, so the
+   addresses the graded sizes are traced at stay put. Larger ones are
+   allocated together, B straight after A. */
+#define MAXN_STATIC 256
+static int A[MAXN_STATIC][MAXN_STATIC];
+static int B[MAXN_STATIC][MAXN_STATIC];
 static int M;
 static int N;
 
 
 int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
-    int C[M][N];
-    memset(C,0,sizeof(C));
-    correctTrans(M,N,A,C);
+    /* compared element by element rather than against a correctTrans
+       copy, which would not fit on the stack for large matrices */
     for(int i=0;i<M;i++) {
         for(int j=0;j<N;j++) {
-            if(B[i][j]!=C[i][j]) {
-                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,C[i][j],B[i][j],i,j);
+            if(B[i][j]!=A[j][i]) {
+                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n",fn,A[j][i],B[i][j],i,j);
                 return 0;
             }
         }
@@ -70,11 +73,25 @@ int main(int argc, char* argv[]){
     }
 
 
+    if (M < 1 || N < 1) {
+        printf("./tracegen needs -M and -N.\n");
+        exit(1);
+    }
+    int *a = &A[0][0], *b = &B[0][0];
+    if (M > MAXN_STATIC || N > MAXN_STATIC) {
+        a = malloc(2 * sizeof(int) * M * N);
+        if (!a) {
+            printf("./tracegen could not allocate %dx%d matrices.\n", M, N);
+            exit(1);
+        }
+        b = a + (size_t) M * N;
+    }
+
     /*  Register transpose functions */
     registerFunctions();
 
     /* Fill A with data */
-    initMatrix(M,N, A, B);
+    initMatrix(M,N, (int (*)[M]) a, (int (*)[N]) b);
 
     /* Record marker addresses */
     FILE* marker_fp = fopen(".marker","w");
@@ -82,24 +99,24 @@ int main(int argc, char* argv[]){
     fprintf(marker_fp, "%llx %llx %llx %llx",
             (unsigned long long int) &MARKER_START,
             (unsigned long long int) &MARKER_END,
-            (unsigned long long int) A,
-            (unsigned long long int) B );
+            (unsigned long long int) a,
+            (unsigned long long int) b );
     fclose(marker_fp);
 
     if (-1==selectedFunc) {
         /* Invoke registered transpose functions */
         for (i=0; i < func_counter; i++) {
             MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
+            (*func_list[i].func_ptr)(M, N, (int (*)[M]) a, (int (*)[N]) b);
             MARKER_END = 34;
-            if (!validate(i,M,N,A,B))
+            if (!validate(i,M,N,(int (*)[M]) a,(int (*)[N]) b))
                 return i+1;
         }
     } else {
         MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
+        (*func_list[selectedFunc].func_ptr)(M, N, (int (*)[M]) a, (int (*)[N]) b);
         MARKER_END = 34;
-        if (!validate(selectedFunc,M,N,A,B))
+        if (!validate(selectedFunc,M,N,(int (*)[M]) a,(int (*)[N]) b))
             return selectedFunc+1;
 
     }
@@ -0,0 +1,105 @@
+/*
+ * tracepipe.c - Parse a streamed trace on its own thread
+ *
+ * The parser fills a batch slot outside the lock and only takes it to
+ * publish the slot; the consumer likewise works through a whole batch
+ * before handing its slot back. Slots are never shared: the parser
+ * waits while all TRACE_PIPE_DEPTH of them are full or in use, or
+ * until trace_pipe_stop tells it to give up.
+ */
+#include <stdlib.h>
+
+#include "tracepipe.h"
+
+static void* parser_main(void* arg)
+{
+    struct trace_pipe* tp = (struct trace_pipe*) arg;
+    int more = 1;
+
+    while (more) {
+        pthread_mutex_lock(&tp->lock);
+        while (tp->tail - tp->head == TRACE_PIPE_DEPTH && !tp->stop)
+            pthread_cond_wait(&tp->not_full, &tp->lock);
+        if (tp->stop) {
+            pthread_mutex_unlock(&tp->lock);
+            break;
+        }
+        struct trace_batch* b = &tp->slots[tp->tail % TRACE_PIPE_DEPTH];
+        pthread_mutex_unlock(&tp->lock);
+
+        b->n = 0;
+        while (b->n < TRACE_PIPE_BATCH && (more = trace_next(tp->tr, &b->acc[b->n])))
+            b->n++;
+
+        pthread_mutex_lock(&tp->lock);
+        if (b->n)
+            tp->tail++;
+        tp->done = !more;
+        pthread_cond_signal(&tp->not_empty);
+        pthread_mutex_unlock(&tp->lock);
+    }
+    return NULL;
+}
+
+int trace_pipe_start(struct trace_pipe* tp, struct trace_reader* tr)
+{
+    tp->tr = tr;
+    tp->head = tp->tail = 0;
+    tp->done = tp->stop = 0;
+    tp->cur = NULL;
+    tp->cur_pos = 0;
+    tp->slots = (struct trace_batch*) malloc(TRACE_PIPE_DEPTH * sizeof(struct trace_batch));
+    if (!tp->slots)
+        return -1;
+
+    pthread_mutex_init(&tp->lock, NULL);
+    pthread_cond_init(&tp->not_empty, NULL);
+    pthread_cond_init(&tp->not_full, NULL);
+    if (pthread_create(&tp->thread, NULL, parser_main, tp) != 0) {
+        free(tp->slots);
+        return -1;
+    }
+    return 0;
+}
+
+int trace_pipe_next(struct trace_pipe* tp, struct vg_acc_t* acc)
+{
+    if (tp->cur && tp->cur_pos < tp->cur->n) {
+        *acc = tp->cur->acc[tp->cur_pos++];
+        return 1;
+    }
+
+    pthread_mutex_lock(&tp->lock);
+    if (tp->cur) {
+        // give the finished batch back
+        tp->head++;
+        tp->cur = NULL;
+        pthread_cond_signal(&tp->not_full);
+    }
+    while (tp->head == tp->tail && !tp->done)
+        pthread_cond_wait(&tp->not_empty, &tp->lock);
+    if (tp->head != tp->tail)
+        tp->cur = &tp->slots[tp->head % TRACE_PIPE_DEPTH];
+    pthread_mutex_unlock(&tp->lock);
+
+    if (!tp->cur)
+        return 0;
+    tp->cur_pos = 1;
+    *acc = tp->cur->acc[0];
+    return 1;
+}
+
+void trace_pipe_stop(struct trace_pipe* tp)
+{
+    // the consumer may be giving up early, so wake a parser waiting on it
+    pthread_mutex_lock(&tp->lock);
+    tp->stop = 1;
+    pthread_cond_broadcast(&tp->not_full);
+    pthread_mutex_unlock(&tp->lock);
+
+    pthread_join(tp->thread, NULL);
+    pthread_mutex_destroy(&tp->lock);
+    pthread_cond_destroy(&tp->not_empty);
+    pthread_cond_destroy(&tp->not_full);
+    free(tp->slots);
+}
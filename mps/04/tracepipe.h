@@ -0,0 +1,53 @@
+/*
+ * tracepipe.h - Parse a streamed trace on its own thread
+ */
+#ifndef TRACEPIPE_H
+#define TRACEPIPE_H
+
+#include <pthread.h>
+
+#include "trace.h"
+
+#define TRACE_PIPE_BATCH 4096 // accesses handed over at a time
+#define TRACE_PIPE_DEPTH 8    // batches parsed ahead at most
+
+struct trace_batch {
+    size_t n;
+    struct vg_acc_t acc[TRACE_PIPE_BATCH];
+};
+
+struct trace_pipe {
+    struct trace_reader* tr;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    struct trace_batch* slots;
+    size_t head;    // batches the consumer has finished with
+    size_t tail;    // batches the parser has filled
+    int done;       // the parser hit the end of the trace
+    int stop;       // the consumer wants no more, the parser should return
+
+    struct trace_batch* cur; // consumer's batch, slots[head % DEPTH]
+    size_t cur_pos;
+};
+
+/*
+ * trace_pipe_start - start a thread parsing tr into a bounded queue of
+ *     batches. When the consumer falls behind the thread blocks, and so
+ *     in turn does whatever is writing the pipe. Returns 0 or -1.
+ */
+int trace_pipe_start(struct trace_pipe* tp, struct trace_reader* tr);
+
+// next access, like trace_next
+int trace_pipe_next(struct trace_pipe* tp, struct vg_acc_t* acc);
+
+/*
+ * trace_pipe_stop - stop the parser, wait for it and free the queue. May
+ *     be called at any time, not just once trace_pipe_next has returned
+ *     0: a parser waiting for room gives up, and one still reading
+ *     finishes its batch first.
+ */
+void trace_pipe_stop(struct trace_pipe* tp);
+
+#endif
@@ -0,0 +1,9 @@
+/* Generated by ./transtune -o trans-tuned.h for s=5, E=1, b=5 */
+static const struct {
+    int M, N;
+    struct trans_param param;
+} trans_tuned[] = {
+    { 32, 32, { 0, 0, 0, 0, 3 } }, /* 272 misses */
+    { 64, 64, { 8, 8, 1, 0, 2 } }, /* 1216 misses */
+    { 61, 67, { 17, 4, 0, 0, 1 } }, /* 1708 misses */
+};
@@ -0,0 +1,273 @@
+/*
+ * transbench.c - Native transpose bandwidth, transpose.c against trans.c
+ *
+ * Usage: ./transbench [-h] [-n <max>] [-t <seconds>] [-j <threads>]
+ *
+ * Square sizes from 32 up to max (default 16384, two 1GB matrices) and
+ * 61x67 are transposed with correctTrans, trans.c's transpose_generic
+ * (8x8 blocks, built at -O2) and transpose_simd's kernels, with and
+ * without non-temporal stores, then the cache-oblivious
+ * transpose_recursive and, for square sizes, the in place transposes,
+ * tiled and recursive. Each is repeated for about the given time
+ * (default 0.2s) and reported in GB/s, counting A read and B written
+ * (or A read and written in place). Every result is checked.
+ *
+ * With -j the report is instead how transpose_parallel scales at n x n
+ * (-n, so give a size well past the last level cache) from 1 to the
+ * given number of threads, next to a STREAM style copy on the same
+ * threads, which is as fast as moving the same bytes can go.
+ */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "cachelab.h"
+#include "tpool.h"
+#include "transpose.h"
+
+// trans-native.o
+extern void native_transpose_generic(int M, int N, int A[N][M], int B[M][N],
+                                     const unsigned short bsize);
+
+static double min_time = 0.2;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+enum variant { CORRECT, GENERIC, SCALAR, SSE2, AVX2, AVX2_NT, RECURSIVE,
+               INPLACE_BLOCKED, INPLACE };
+static const char* names[] = { "correct", "generic", "scalar", "sse2", "avx2",
+                               "avx2 nt", "recursive", "inpl blk", "inpl rec" };
+
+static void run(enum variant v, int M, int N, int* A, int* B)
+{
+    switch (v) {
+        case CORRECT:
+            correctTrans(M, N, (int (*)[M]) A, (int (*)[N]) B);
+            break;
+        case GENERIC:
+            native_transpose_generic(M, N, (int (*)[M]) A, (int (*)[N]) B, 8);
+            break;
+        case RECURSIVE:
+            transpose_recursive(M, N, A, B);
+            break;
+        case INPLACE_BLOCKED:
+            transpose_inplace_blocked(M, A);
+            break;
+        case INPLACE:
+            transpose_inplace(M, A);
+            break;
+        default:
+            transpose_simd(M, N, A, B);
+            break;
+    }
+}
+
+/*
+ * bench - best pass of about min_time of them, in GB/s; 0 if the kernel
+ *     is missing or, in place, the matrix is not square. The in place
+ *     kernels transpose A back and forth, A[i] starting out as i.
+ */
+static double bench(enum variant v, int M, int N, int* A, int* B)
+{
+    const size_t elems = (size_t) M * N;
+    const int inplace = v == INPLACE || v == INPLACE_BLOCKED;
+    double best = 1e30, start = now();
+    int passes = 0;
+
+    if (inplace && M != N)
+        return 0;
+    if (transpose_set_isa(TRANSPOSE_AVX2) < 0)
+        transpose_set_isa(TRANSPOSE_SSE2);
+    transpose_set_nt(TRANSPOSE_NT_BYTES);
+    if (v == SCALAR || v == SSE2 || v == AVX2 || v == AVX2_NT) {
+        static const enum transpose_isa_t isa[] = {
+            [SCALAR] = TRANSPOSE_SCALAR, [SSE2] = TRANSPOSE_SSE2,
+            [AVX2] = TRANSPOSE_AVX2, [AVX2_NT] = TRANSPOSE_AVX2,
+        };
+        if (transpose_set_isa(isa[v]) < 0)
+            return 0;
+        // the nt row always streams, the others never do
+        transpose_set_nt(v == AVX2_NT ? 0 : (size_t) -1);
+    }
+
+    memset(B, 0, elems * sizeof(int));
+    do {
+        double t = now();
+        run(v, M, N, A, B);
+        t = now() - t;
+        if (t < best)
+            best = t;
+        passes++;
+    } while (now() - start < min_time || passes < 2);
+
+    for (size_t i = 0; i < (size_t) N; i++)
+        for (size_t j = 0; j < (size_t) M; j++)
+            if (inplace ? A[i * M + j] != (int) (passes % 2 ? j * M + i : i * M + j)
+                        : B[j * N + i] != A[i * M + j]) {
+                printf("%s is wrong at %dx%d!\n", names[v], M, N);
+                exit(1);
+            }
+    if (inplace && passes % 2)
+        run(v, M, N, A, B);
+    return 2.0 * elems * sizeof(int) / best / 1e9;
+}
+
+static void bench_size(int M, int N)
+{
+    const size_t bytes = (size_t) M * N * sizeof(int);
+    int *A, *B;
+
+    if (posix_memalign((void**) &A, 64, bytes) || posix_memalign((void**) &B, 64, bytes)) {
+        fprintf(stderr, "transbench: no memory for %dx%d\n", M, N);
+        exit(1);
+    }
+    for (size_t i = 0; i < (size_t) M * N; i++)
+        A[i] = (int) i;
+
+    printf("%5dx%-5d", M, N);
+    for (enum variant v = CORRECT; v <= INPLACE; v++) {
+        double gbs = bench(v, M, N, A, B);
+        if (gbs > 0)
+            printf(" %9.2f", gbs);
+        else
+            printf(" %9s", "-");
+        fflush(stdout);
+    }
+    printf("\n");
+    free(A);
+    free(B);
+}
+
+// STREAM copy of a tpool_split share of len ints, every thread its own
+struct copy_job {
+    const int* src;
+    int* dst;
+    size_t len;
+};
+
+static void copy_share(struct tpool* pool, int id, void* arg)
+{
+    const struct copy_job* job = (const struct copy_job*) arg;
+    uint32_t first, end;
+
+    tpool_share(pool, id, 1 << 16, &first, &end);
+    const size_t lo = job->len * first >> 16, hi = job->len * end >> 16;
+    for (size_t i = lo; i < hi; i++)
+        job->dst[i] = job->src[i];
+}
+
+// best time of about min_time of transpose_parallel (copy 0) or copies
+static double best_time(struct tpool* pool, int n, int* A, int* B, int copy)
+{
+    struct copy_job job = { A, B, (size_t) n * n };
+    double best = 1e30, start = now();
+    int passes = 0;
+
+    do {
+        double t = now();
+        if (copy)
+            tpool_run(pool, copy_share, &job);
+        else
+            transpose_parallel(pool, n, n, A, B);
+        t = now() - t;
+        if (t < best)
+            best = t;
+        passes++;
+    } while (now() - start < min_time || passes < 2);
+    return best;
+}
+
+static void scaling(int n, int max_threads)
+{
+    const size_t elems = (size_t) n * n, bytes = elems * sizeof(int);
+    double base = 0;
+    int* A;
+
+    if (posix_memalign((void**) &A, 64, bytes)) {
+        fprintf(stderr, "transbench: no memory for %dx%d\n", n, n);
+        exit(1);
+    }
+    for (size_t i = 0; i < elems; i++)
+        A[i] = (int) i;
+
+    printf("%dx%d, GB/s\nthreads transpose      copy  of copy  speedup   steals\n", n, n);
+    for (int t = 1; t <= max_threads; t = t * 2 > max_threads && t < max_threads ? max_threads : t * 2) {
+        struct tpool pool;
+        int* B;
+
+        if (tpool_start(&pool, t) < 0 || posix_memalign((void**) &B, 64, bytes)) {
+            fprintf(stderr, "transbench: could not start %d threads\n", t);
+            exit(1);
+        }
+        transpose_first_touch(&pool, n, n, B);
+        for (int i = 0; i < t; i++)
+            pool.threads[i].steals = 0;
+
+        double tt = best_time(&pool, n, A, B, 0);
+        for (size_t i = 0; i < (size_t) n; i++)
+            for (size_t j = 0; j < (size_t) n; j++)
+                if (B[j * n + i] != A[i * n + j]) {
+                    printf("transpose_parallel is wrong on %d threads!\n", t);
+                    exit(1);
+                }
+        uint64_t steals = 0;
+        for (int i = 0; i < t; i++)
+            steals += pool.threads[i].steals;
+        double tc = best_time(&pool, n, A, B, 1);
+
+        if (t == 1)
+            base = tt;
+        printf("%7d %9.2f %9.2f %7.0f%% %7.2fx %8" PRIu64 "\n", t, 2.0 * bytes / tt / 1e9,
+               2.0 * bytes / tc / 1e9, 100 * tc / tt, base / tt, steals);
+        fflush(stdout);
+        tpool_stop(&pool);
+        free(B);
+    }
+    free(A);
+}
+
+int main(int argc, char** argv)
+{
+    int c, max = 16384, threads = 0;
+
+    while ((c = getopt(argc, argv, "hn:t:j:")) != -1) {
+        switch (c) {
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'n':
+                max = atoi(optarg);
+                break;
+            case 't':
+                min_time = atof(optarg);
+                break;
+            default:
+                printf("Usage: %s [-h] [-n <max size>] [-t <seconds per kernel>] [-j <threads>]\n",
+                       argv[0]);
+                return c != 'h';
+        }
+    }
+    if (threads > 0) {
+        scaling(max, threads < TPOOL_MAX_THREADS ? threads : TPOOL_MAX_THREADS);
+        return 0;
+    }
+
+    printf("GB/s      ");
+    for (enum variant v = CORRECT; v <= INPLACE; v++)
+        printf(" %9s", names[v]);
+    printf("\n");
+
+    bench_size(61, 67);
+    for (int n = 32; n <= max; n *= 2)
+        bench_size(n, n);
+    return 0;
+}
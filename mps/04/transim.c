@@ -0,0 +1,121 @@
+/*
+ * transim.c - Simulate transpose functions in process, without valgrind
+ *
+ * The hooks below are what gcc calls before each load and store in
+ * trans-inst.o. Outside transim_eval they do nothing; inside it they
+ * pass accesses that fall in A or B to the cache, translated to where
+ * tracegen's arrays are when valgrind traces it. Everything else, the
+ * locals on the stack included, is dropped, just as test-trans drops
+ * everything above 4GB from valgrind's trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cachelab.h"
+#include "cache.h"
+#include "transim.h"
+
+static int A_static[TRANSIM_MAXN * TRANSIM_MAXN];
+static int B_static[TRANSIM_MAXN * TRANSIM_MAXN];
+
+static uint64_t a_start = TRANSIM_A_START;
+static uint64_t b_start = TRANSIM_B_START;
+
+// while transim_eval runs fn: the cache, and the matrices and where they map
+static struct cache_t* active;
+static int *A, *B;
+static uintptr_t bytes;
+static uint64_t a_sim, b_sim;
+static uint64_t accesses;
+
+void transim_layout(uint64_t a, uint64_t b)
+{
+    a_start = a;
+    b_start = b;
+}
+
+static inline void record(const void* p, int write)
+{
+    uintptr_t addr = (uintptr_t) p;
+
+    if (!active)
+        return;
+    if (addr - (uintptr_t) A < bytes)
+        cache_access(active, a_sim + (addr - (uintptr_t) A), write);
+    else if (addr - (uintptr_t) B < bytes)
+        cache_access(active, b_sim + (addr - (uintptr_t) B), write);
+    else
+        return;
+    accesses++;
+}
+
+/*
+ * Instrumentation hooks. Each access counts once whatever its size, as
+ * in csim; none of the transpose functions make unaligned accesses.
+ */
+#define TRANSIM_HOOKS(size) \
+    void __asan_load##size##_noabort(const void* p) { record(p, 0); } \
+    void __asan_store##size##_noabort(const void* p) { record(p, 1); }
+
+TRANSIM_HOOKS(1)
+TRANSIM_HOOKS(2)
+TRANSIM_HOOKS(4)
+TRANSIM_HOOKS(8)
+TRANSIM_HOOKS(16)
+
+void __asan_loadN_noabort(const void* p, size_t size) { record(p, 0); }
+void __asan_storeN_noabort(const void* p, size_t size) { record(p, 1); }
+
+int transim_eval(void (*fn)(int M, int N, int[N][M], int[M][N]),
+                 int M, int N, unsigned s, unsigned E, unsigned b,
+                 struct transim_result* r)
+{
+    struct cache_t cache;
+    const size_t elems = (size_t) M * N;
+
+    A = A_static;
+    B = B_static;
+    bytes = elems * sizeof(int);
+    a_sim = a_start;
+    b_sim = b_start;
+    if (M > TRANSIM_MAXN || N > TRANSIM_MAXN) {
+        A = malloc(2 * bytes);
+        if (!A) {
+            perror("transim");
+            return -1;
+        }
+        B = A + elems;
+    }
+    if (b_sim < a_sim + bytes && a_sim < b_sim + bytes)
+        b_sim = a_sim + bytes;
+    if (cache_init(&cache, s, E, b, REPL_LRU) < 0) {
+        if (A != A_static)
+            free(A);
+        return -1;
+    }
+    initMatrix(M, N, (int (*)[M]) A, (int (*)[N]) B);
+
+    accesses = 0;
+    active = &cache;
+    fn(M, N, (int (*)[M]) A, (int (*)[N]) B);
+    active = NULL;
+
+    r->hits = cache.hits;
+    r->misses = cache.misses;
+    r->evictions = cache.evictions;
+    r->accesses = accesses;
+    cache_free(&cache);
+
+    // same check as tracegen's validate
+    r->correct = 1;
+    for (size_t i = 0; i < N && r->correct; i++)
+        for (size_t j = 0; j < M; j++)
+            if (B[j * N + i] != A[i * M + j]) {
+                r->correct = 0;
+                break;
+            }
+    if (A != A_static)
+        free(A);
+    return 0;
+}
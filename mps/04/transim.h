@@ -0,0 +1,48 @@
+/*
+ * transim.h - Simulate transpose functions in process, without valgrind
+ *
+ * trans-inst.o is trans.c compiled so that every load and store calls
+ * back into transim.c (gcc's -fsanitize=kernel-address hooks, with no
+ * sanitizer runtime behind them). While a function runs under
+ * transim_eval its accesses to A and B go straight into a cache_t.
+ */
+#ifndef TRANSIM_H
+#define TRANSIM_H
+
+#include <inttypes.h>
+
+// matrices up to this size are where tracegen's static arrays are
+#define TRANSIM_MAXN 256
+
+/*
+ * Where tracegen's A and B sit when valgrind runs it, as recorded in
+ * .marker. Only the low address bits matter to a small cache, but using
+ * the same addresses keeps traces and counts comparable. Larger matrices
+ * are allocated by tracegen with B straight after A, and are simulated
+ * that way when B would otherwise overlap A.
+ */
+#define TRANSIM_A_START 0x10d140
+#define TRANSIM_B_START (TRANSIM_A_START + TRANSIM_MAXN * TRANSIM_MAXN * 4)
+
+struct transim_result {
+    int correct;
+    unsigned hits;
+    unsigned misses;
+    unsigned evictions;
+    uint64_t accesses;
+};
+
+// place the simulated A and B at these addresses (default: TRANSIM_*_START)
+void transim_layout(uint64_t a_start, uint64_t b_start);
+
+/*
+ * transim_eval - run fn on an M x N matrix, simulating its accesses to A
+ *     and B on a cold cache with 2^s sets of E lines of 2^b bytes (LRU),
+ *     then check that B is A's transpose. Returns 0, or -1 if the cache
+ *     or the matrices could not be set up.
+ */
+int transim_eval(void (*fn)(int M, int N, int[N][M], int[M][N]),
+                 int M, int N, unsigned s, unsigned E, unsigned b,
+                 struct transim_result* r);
+
+#endif
@@ -0,0 +1,360 @@
+/*
+ * transpose.c - Native speed int matrix transpose
+ *
+ * The matrix is walked in 64x64 tiles, small enough that a tile of A and
+ * of B fit in L1 together, and each tile in 8x8 (or 4x4) blocks that are
+ * transposed in registers. Within a tile the blocks go down A's columns,
+ * so consecutive blocks write the two halves of the same lines of B,
+ * which is what lets non-temporal stores combine into whole lines.
+ *
+ * transpose_recursive and transpose_inplace split recursively instead of
+ * using fixed tiles, down to leaves made of the same kernel blocks.
+ *
+ * transpose_parallel hands out rows of B's tiles to a tpool: each thread
+ * owns the rows it touched first, and steals from the others when it
+ * runs out.
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#include "tpool.h"
+#include "transpose.h"
+
+#define TILE 64
+
+typedef void (*block_fn)(const int* a, size_t lda, int* b, size_t ldb, int nt);
+
+static void block_scalar(const int* a, size_t lda, int* b, size_t ldb, int nt)
+{
+    for (int r = 0; r < 8; r++)
+        for (int c = 0; c < 8; c++)
+            b[c * ldb + r] = a[r * lda + c];
+}
+
+__attribute__((target("sse2")))
+static void block_sse2(const int* a, size_t lda, int* b, size_t ldb, int nt)
+{
+    __m128i r0 = _mm_loadu_si128((const __m128i*) (a + 0 * lda));
+    __m128i r1 = _mm_loadu_si128((const __m128i*) (a + 1 * lda));
+    __m128i r2 = _mm_loadu_si128((const __m128i*) (a + 2 * lda));
+    __m128i r3 = _mm_loadu_si128((const __m128i*) (a + 3 * lda));
+
+    // a00 a10 a01 a11, a20 a30 a21 a31, a02 a12 a03 a13, a22 a32 a23 a33
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+    __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+    __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+    __m128i c[4] = {
+        _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+        _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3),
+    };
+    for (int i = 0; i < 4; i++) {
+        __m128i* dst = (__m128i*) (b + i * ldb);
+        if (nt && ((uintptr_t) dst & 15) == 0)
+            _mm_stream_si128(dst, c[i]);
+        else
+            _mm_storeu_si128(dst, c[i]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void block_avx2(const int* a, size_t lda, int* b, size_t ldb, int nt)
+{
+    __m256i r[8], t[8], u[8];
+
+    for (int i = 0; i < 8; i++)
+        r[i] = _mm256_loadu_si256((const __m256i*) (a + i * lda));
+
+    // pairs of rows interleaved: a00 a10 a01 a11 | a04 a14 a05 a15 ...
+    for (int i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    // quarter columns: u[0] is a00 a10 a20 a30 | a04 a14 a24 a34
+    for (int i = 0; i < 8; i += 4) {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    // join the halves from rows 0-3 and rows 4-7
+    for (int i = 0; i < 4; i++) {
+        __m256i lo = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        __m256i hi = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+        __m256i* dlo = (__m256i*) (b + i * ldb);
+        __m256i* dhi = (__m256i*) (b + (i + 4) * ldb);
+        if (nt && ((uintptr_t) dlo & 31) == 0 && ((uintptr_t) dhi & 31) == 0) {
+            _mm256_stream_si256(dlo, lo);
+            _mm256_stream_si256(dhi, hi);
+        } else {
+            _mm256_storeu_si256(dlo, lo);
+            _mm256_storeu_si256(dhi, hi);
+        }
+    }
+}
+
+static block_fn block = NULL;
+static size_t block_dim;
+static size_t nt_bytes = TRANSPOSE_NT_BYTES;
+
+int transpose_set_isa(enum transpose_isa_t isa)
+{
+    switch (isa) {
+        case TRANSPOSE_SCALAR:
+            block = block_scalar;
+            block_dim = 8;
+            return 0;
+        case TRANSPOSE_SSE2:
+            block = block_sse2;
+            block_dim = 4;
+            return 0;
+        case TRANSPOSE_AVX2:
+            __builtin_cpu_init();
+            if (!__builtin_cpu_supports("avx2"))
+                return -1;
+            block = block_avx2;
+            block_dim = 8;
+            return 0;
+    }
+    return -1;
+}
+
+void transpose_set_nt(size_t bytes)
+{
+    nt_bytes = bytes;
+}
+
+/*
+ * transpose_rect - transpose a rows x cols piece of A into B: whole
+ *     kernel blocks going down A's columns, then the columns right of
+ *     the last block and the rows below it one element at a time
+ */
+static void transpose_rect(const int* A, size_t lda, int* B, size_t ldb,
+                           size_t rows, size_t cols, int nt)
+{
+    const size_t k = block_dim;
+    const size_t fr = rows - rows % k, fc = cols - cols % k;
+
+    for (size_t j = 0; j < fc; j += k)
+        for (size_t i = 0; i < fr; i += k)
+            block(A + i * lda + j, lda, B + j * ldb + i, ldb, nt);
+
+    for (size_t i = 0; i < rows; i++)
+        for (size_t j = fc; j < cols; j++)
+            B[j * ldb + i] = A[i * lda + j];
+    for (size_t j = 0; j < fc; j++)
+        for (size_t i = fr; i < rows; i++)
+            B[j * ldb + i] = A[i * lda + j];
+}
+
+static void choose_isa(void)
+{
+    if (!block && transpose_set_isa(TRANSPOSE_AVX2) < 0)
+        transpose_set_isa(TRANSPOSE_SSE2);
+}
+
+void transpose_simd(int M, int N, const int* A, int* B)
+{
+    choose_isa();
+
+    const size_t m = M, n = N;
+    const int nt = m * n * sizeof(int) >= nt_bytes;
+
+    for (size_t ti = 0; ti < n; ti += TILE)
+        for (size_t tj = 0; tj < m; tj += TILE)
+            transpose_rect(A + ti * m + tj, m, B + tj * n + ti, n,
+                           ti + TILE < n ? TILE : n - ti,
+                           tj + TILE < m ? TILE : m - tj, nt);
+    if (nt)
+        _mm_sfence();
+}
+
+/*
+ * Cache-oblivious versions: halve the longer side until both fit a leaf.
+ * Every level of the hierarchy then sees pieces that fit it at some
+ * depth of the recursion, whatever its size. Splits are rounded to
+ * multiples of 8 so the leaves are made of whole kernel blocks.
+ */
+#define LEAF 32
+
+static size_t split(size_t len)
+{
+    return (len / 2 + 7) & ~(size_t) 7;
+}
+
+static void recurse(const int* A, size_t lda, int* B, size_t ldb,
+                    size_t rows, size_t cols, int nt)
+{
+    if (rows <= LEAF && cols <= LEAF) {
+        transpose_rect(A, lda, B, ldb, rows, cols, nt);
+    } else if (rows >= cols) {
+        size_t h = split(rows);
+        recurse(A, lda, B, ldb, h, cols, nt);
+        recurse(A + h * lda, lda, B + h, ldb, rows - h, cols, nt);
+    } else {
+        size_t w = split(cols);
+        recurse(A, lda, B, ldb, rows, w, nt);
+        recurse(A + w, lda, B + w * ldb, ldb, rows, cols - w, nt);
+    }
+}
+
+void transpose_recursive(int M, int N, const int* A, int* B)
+{
+    choose_isa();
+
+    const int nt = (size_t) M * N * sizeof(int) >= nt_bytes;
+    recurse(A, M, B, N, N, M, nt);
+    if (nt)
+        _mm_sfence();
+}
+
+/*
+ * swap_rect - swap the rows x cols piece X with the transpose of the
+ *     cols x rows piece Y, a block at a time through a buffer
+ */
+static void swap_rect(int* X, int* Y, size_t ld, size_t rows, size_t cols)
+{
+    const size_t k = block_dim;
+    const size_t fr = rows - rows % k, fc = cols - cols % k;
+    int tmp[8 * 8];
+
+    for (size_t i = 0; i < fr; i += k)
+        for (size_t j = 0; j < fc; j += k) {
+            int* x = X + i * ld + j;
+            int* y = Y + j * ld + i;
+            block(x, ld, tmp, k, 0);
+            block(y, ld, x, ld, 0);
+            for (size_t r = 0; r < k; r++)
+                memcpy(y + r * ld, tmp + r * k, k * sizeof(int));
+        }
+
+    for (size_t i = 0; i < rows; i++)
+        for (size_t j = i < fr ? fc : 0; j < cols; j++) {
+            int t = X[i * ld + j];
+            X[i * ld + j] = Y[j * ld + i];
+            Y[j * ld + i] = t;
+        }
+}
+
+// transpose the n x n diagonal piece at A in place
+static void inplace_leaf(int* A, size_t ld, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = i + 1; j < n; j++) {
+            int t = A[i * ld + j];
+            A[i * ld + j] = A[j * ld + i];
+            A[j * ld + i] = t;
+        }
+}
+
+static void recurse_swap(int* X, int* Y, size_t ld, size_t rows, size_t cols)
+{
+    if (rows <= LEAF && cols <= LEAF) {
+        swap_rect(X, Y, ld, rows, cols);
+    } else if (rows >= cols) {
+        size_t h = split(rows);
+        recurse_swap(X, Y, ld, h, cols);
+        recurse_swap(X + h * ld, Y + h, ld, rows - h, cols);
+    } else {
+        size_t w = split(cols);
+        recurse_swap(X, Y, ld, rows, w);
+        recurse_swap(X + w, Y + w * ld, ld, rows, cols - w);
+    }
+}
+
+static void recurse_inplace(int* A, size_t ld, size_t n)
+{
+    if (n <= LEAF) {
+        inplace_leaf(A, ld, n);
+        return;
+    }
+    size_t h = split(n);
+    recurse_inplace(A, ld, h);
+    recurse_inplace(A + h * ld + h, ld, n - h);
+    // top right with the transpose of bottom left
+    recurse_swap(A + h, A + h * ld, ld, h, n - h);
+}
+
+void transpose_inplace(int n, int* A)
+{
+    choose_isa();
+    recurse_inplace(A, n, n);
+}
+
+void transpose_inplace_blocked(int n, int* A)
+{
+    choose_isa();
+
+    const size_t m = n;
+    for (size_t ti = 0; ti < m; ti += TILE) {
+        const size_t h = ti + TILE < m ? TILE : m - ti;
+        inplace_leaf(A + ti * m + ti, m, h);
+        for (size_t tj = ti + TILE; tj < m; tj += TILE)
+            swap_rect(A + ti * m + tj, A + tj * m + ti, m, h,
+                      tj + TILE < m ? TILE : m - tj);
+    }
+}
+
+// a transpose_parallel or transpose_first_touch call
+struct par_job {
+    int M, N;
+    const int* A;
+    int* B;
+    int nt;
+};
+
+// tiles of B a task covers: TILE rows of B, i.e. TILE columns of A
+static uint32_t tile_rows(int M)
+{
+    return (M + TILE - 1) / TILE;
+}
+
+static void par_transpose(struct tpool* pool, int id, void* arg)
+{
+    const struct par_job* job = (const struct par_job*) arg;
+    const size_t m = job->M, n = job->N;
+    uint32_t task;
+
+    while (tpool_next(pool, id, &task)) {
+        const size_t j = (size_t) task * TILE;
+        const size_t cols = j + TILE < m ? TILE : m - j;
+        for (size_t i = 0; i < n; i += TILE)
+            transpose_rect(job->A + i * m + j, m, job->B + j * n + i, n,
+                           i + TILE < n ? TILE : n - i, cols, job->nt);
+    }
+    if (job->nt)
+        _mm_sfence();
+}
+
+void transpose_parallel(struct tpool* pool, int M, int N, const int* A, int* B)
+{
+    struct par_job job = { M, N, A, B, (size_t) M * N * sizeof(int) >= nt_bytes };
+
+    choose_isa();
+    tpool_split(pool, tile_rows(M));
+    tpool_run(pool, par_transpose, &job);
+}
+
+static void par_touch(struct tpool* pool, int id, void* arg)
+{
+    const struct par_job* job = (const struct par_job*) arg;
+    uint32_t first, end;
+
+    tpool_share(pool, id, tile_rows(job->M), &first, &end);
+    size_t lo = (size_t) first * TILE, hi = (size_t) end * TILE;
+    if (hi > (size_t) job->M)
+        hi = job->M;
+    if (lo < hi)
+        memset(job->B + lo * job->N, 0, (hi - lo) * job->N * sizeof(int));
+}
+
+void transpose_first_touch(struct tpool* pool, int M, int N, int* B)
+{
+    struct par_job job = { M, N, NULL, B, 0 };
+
+    tpool_run(pool, par_touch, &job);
+}
@@ -0,0 +1,71 @@
+/*
+ * transpose.h - Native speed int matrix transpose
+ *
+ * Unlike trans.c, which is tuned for misses on test-trans's 1KB cache,
+ * these are for wall clock time on a real machine.
+ */
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include <stddef.h>
+
+struct tpool;
+
+// in register kernels transpose_simd can use, the widest the CPU has by default
+enum transpose_isa_t {
+    TRANSPOSE_SCALAR, // 8x8 blocks of element copies
+    TRANSPOSE_SSE2,   // 4x4 blocks, unpack
+    TRANSPOSE_AVX2,   // 8x8 blocks, unpack and lane permute
+};
+
+// force a kernel, for benchmarking. Returns -1 if the CPU lacks it.
+int transpose_set_isa(enum transpose_isa_t isa);
+
+/*
+ * Destinations of at least this many bytes are written with
+ * non-temporal stores, since they would only push A out of the cache.
+ * Streaming into anything that still fits in the cache is a loss, by
+ * 2x and more below 64MB on the machine this was tuned on, so the bar
+ * is set well above last level cache sizes.
+ */
+#define TRANSPOSE_NT_BYTES (256 << 20)
+
+// change the non-temporal store threshold, 0 for always
+void transpose_set_nt(size_t bytes);
+
+/*
+ * transpose_simd - B = A^T, with A N rows of M and B M rows of N as in
+ *     trans.c. Any M and N work; rows and columns past the last whole
+ *     kernel block are copied an element at a time.
+ */
+void transpose_simd(int M, int N, const int* A, int* B);
+
+/*
+ * transpose_recursive - as transpose_simd, but cache-oblivious: the
+ *     longer side is halved until the pieces are 32x32 or smaller, so no
+ *     tile size has to match the caches
+ */
+void transpose_recursive(int M, int N, const int* A, int* B);
+
+// transpose the n x n matrix A in place, recursively (cache-oblivious)
+void transpose_inplace(int n, int* A);
+
+// transpose_inplace in fixed 64x64 tiles, for comparison
+void transpose_inplace_blocked(int n, int* A);
+
+/*
+ * transpose_parallel - transpose_simd on every thread of pool. The tasks
+ *     are rows of 64x64 tiles of B, split evenly between the threads,
+ *     which steal from each other once their own are done.
+ */
+void transpose_parallel(struct tpool* pool, int M, int N, const int* A, int* B);
+
+/*
+ * transpose_first_touch - zero B (M rows of N) on the pool's threads,
+ *     each the rows transpose_parallel will first give it. On a NUMA
+ *     machine that puts B's pages on the node of the thread writing
+ *     them. Call it on freshly allocated, untouched memory.
+ */
+void transpose_first_touch(struct tpool* pool, int M, int N, int* B);
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * transtune.c - Search trans.c's parameterized transpose for the fewest
+ *     misses on the test-trans cache model
+ *
+ * Usage: ./transtune [-h] [-s <s>] [-E <E>] [-b <b>] [-k <top>] [-r <repeats>]
+ *                    [-o <file>] [MxN ...]
+ *
+ * Every block shape up to 24x24 (and 32x32), both block orders, with and
+ * without diagonal handling, and the register staged and quadrant copies
+ * where they apply, is simulated in process as test-trans -i would,
+ * along with the hand written transpose_submit, so a size is only given
+ * a generated kernel when one beats it. The top candidates by misses
+ * are then timed natively (an -O2 build of trans.c with transpose_param
+ * renamed native_transpose_param) and the fastest of those with the
+ * fewest misses is the size's best. With -o the best parameters are
+ * written out as the trans_tuned[] table transpose_tuned looks sizes up
+ * in. Sizes default to the graded ones.
+ */
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "cachelab.h"
+#include "transim.h"
+
+// trans-inst.o: simulated
+extern struct trans_param trans_param;
+extern void transpose_param(int M, int N, int A[N][M], int B[M][N]);
+extern void registerFunctions();
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
+// trans-native.o: timed
+extern struct trans_param native_trans_param;
+extern void native_transpose_param(int M, int N, int A[N][M], int B[M][N]);
+
+#define MAX_SIZES 32
+
+struct candidate {
+    struct trans_param p;
+    unsigned misses;
+    double ns; // per element, 0 if not timed
+};
+
+static unsigned s = 5, E = 1, b = 5;
+static int top = 10, repeats = 200;
+
+static int A[TRANSIM_MAXN][TRANSIM_MAXN];
+static int B[TRANSIM_MAXN][TRANSIM_MAXN];
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// best of repeats native runs, in ns per element
+static double time_native(const struct trans_param* p, int M, int N)
+{
+    double best = 1e30;
+
+    native_trans_param = *p;
+    for (int i = 0; i < repeats; i++) {
+        double t = now();
+        native_transpose_param(M, N, (int (*)[M]) A, (int (*)[N]) B);
+        t = now() - t;
+        if (t < best)
+            best = t;
+    }
+    return best * 1e9 / ((double) M * N);
+}
+
+static int by_misses(const void* x, const void* y)
+{
+    const struct candidate* a = (const struct candidate*) x;
+    const struct candidate* c = (const struct candidate*) y;
+    return (a->misses > c->misses) - (a->misses < c->misses);
+}
+
+static void print_param(FILE* out, const struct trans_param* p)
+{
+    static const char* stages[] = { "element", "registers", "quadrants" };
+
+    if (p->stage == 3) {
+        fprintf(out, "%-28s", "transpose_submit");
+        return;
+    }
+    fprintf(out, "%2dx%-2d %-7s %-4s %-9s", p->bh, p->bw,
+            p->order ? "columns" : "rows", p->diag ? "diag" : "-",
+            stages[p->stage]);
+}
+
+/*
+ * tune - search every variant for an M x N matrix, print the top ones
+ *     and return the best
+ */
+static struct candidate tune(int M, int N)
+{
+    static const int shapes[] = { 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                  16, 17, 18, 19, 20, 21, 22, 23, 24, 32 };
+    const int nshapes = sizeof(shapes) / sizeof(shapes[0]);
+    struct candidate* cand = malloc((nshapes * nshapes * 2 * 4 + 1) * sizeof(struct candidate));
+    struct transim_result r;
+    size_t n = 0, wrong = 0;
+    double t = now();
+
+    if (!cand) {
+        perror("transtune");
+        exit(1);
+    }
+    for (int h = 0; h < nshapes; h++)
+        for (int w = 0; w < nshapes; w++)
+            for (int order = 0; order < 2; order++)
+                for (int v = 0; v < 5; v++) {
+                    // v: element, element with diag, registers, quadrants,
+                    // and (once) transpose_submit
+                    struct trans_param p = { shapes[h], shapes[w], order,
+                                             v == 1, v < 2 ? 0 : v - 1 };
+                    if (p.stage == 1 && p.bw > 8)
+                        continue;
+                    if (p.stage == 2 && (p.bh != 8 || p.bw != 8))
+                        continue;
+                    if (p.stage == 3) {
+                        if (h || w || order)
+                            continue;
+                        p = (struct trans_param) { 0, 0, 0, 0, 3 };
+                    }
+
+                    trans_param = p;
+                    if (transim_eval(transpose_param, M, N, s, E, b, &r) < 0)
+                        exit(1);
+                    if (!r.correct) {
+                        wrong++;
+                        continue;
+                    }
+                    cand[n].p = p;
+                    cand[n].misses = r.misses;
+                    cand[n].ns = 0;
+                    n++;
+                }
+    t = now() - t;
+    qsort(cand, n, sizeof(*cand), by_misses);
+
+    // time the top candidates; among the fewest misses pick the fastest
+    if (n == 0) {
+        fprintf(stderr, "transtune: no variant transposed %dx%d correctly\n", M, N);
+        exit(1);
+    }
+    size_t k = n < top ? n : top;
+    for (size_t i = 0; i < k; i++)
+        cand[i].ns = time_native(&cand[i].p, M, N);
+    struct candidate best = cand[0];
+    for (size_t i = 1; i < k; i++)
+        if (cand[i].misses == best.misses && cand[i].ns < best.ns)
+            best = cand[i];
+
+    printf("%dx%d: %zu variants simulated in %.0f ms (%.2f ms each)%s\n",
+           M, N, n, t * 1e3, t * 1e3 / (n + wrong), wrong ? ", some incorrect!" : "");
+    for (size_t i = 0; i < k; i++) {
+        printf("  %c ", memcmp(&cand[i].p, &best.p, sizeof(best.p)) ? ' ' : '*');
+        print_param(stdout, &cand[i].p);
+        printf(" misses:%-6u %6.2f ns/element\n", cand[i].misses, cand[i].ns);
+    }
+
+    // the hand written functions, for comparison
+    for (int i = 0; i < func_counter; i++) {
+        if (transim_eval(func_list[i].func_ptr, M, N, s, E, b, &r) < 0)
+            exit(1);
+        printf("    %-38s misses:%u%s\n", func_list[i].description, r.misses,
+               r.correct ? "" : " (incorrect)");
+    }
+    free(cand);
+    return best;
+}
+
+static void usage(char* argv0)
+{
+    printf("Usage: %s [-h] [-s <s>] [-E <E>] [-b <b>] [-k <top>] [-r <repeats>]\n"
+           "       [-o <file>] [MxN ...]\n"
+           "\t-h: Print this message\n"
+           "\t-s, -E, -b: Cache to tune for (default: test-trans's 5, 1, 5)\n"
+           "\t-k: Candidates to print and time (default: 10)\n"
+           "\t-r: Native runs per candidate, the best counts (default: 200)\n"
+           "\t-o: Write the best parameters as a trans_tuned[] table\n"
+           "\tMxN: Sizes to tune for (default: 32x32 64x64 61x67)\n", argv0);
+}
+
+int main(int argc, char** argv)
+{
+    int c, nsizes = 0;
+    int sizes[MAX_SIZES][2];
+    struct candidate best[MAX_SIZES];
+    const char* out_path = NULL;
+
+    while ((c = getopt(argc, argv, "hs:E:b:k:r:o:")) != -1) {
+        switch (c) {
+            case 's':
+                s = atoi(optarg);
+                break;
+            case 'E':
+                E = atoi(optarg);
+                break;
+            case 'b':
+                b = atoi(optarg);
+                break;
+            case 'k':
+                top = atoi(optarg);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    for (; optind < argc && nsizes < MAX_SIZES; optind++, nsizes++) {
+        if (sscanf(argv[optind], "%dx%d", &sizes[nsizes][0], &sizes[nsizes][1]) != 2 ||
+            sizes[nsizes][0] < 1 || sizes[nsizes][0] > TRANSIM_MAXN ||
+            sizes[nsizes][1] < 1 || sizes[nsizes][1] > TRANSIM_MAXN) {
+            fprintf(stderr, "%s: bad size %s, want MxN up to %dx%d\n",
+                    argv[0], argv[optind], TRANSIM_MAXN, TRANSIM_MAXN);
+            return 1;
+        }
+    }
+    if (nsizes == 0) {
+        int graded[3][2] = { { 32, 32 }, { 64, 64 }, { 61, 67 } };
+        memcpy(sizes, graded, sizeof(graded));
+        nsizes = 3;
+    }
+    if (top < 1)
+        top = 1;
+
+    registerFunctions();
+    for (int i = 0; i < nsizes; i++)
+        best[i] = tune(sizes[i][0], sizes[i][1]);
+
+    if (out_path) {
+        FILE* out = fopen(out_path, "w");
+        if (!out) {
+            perror(out_path);
+            return 1;
+        }
+        fprintf(out, "/* Generated by ./transtune -o %s for s=%u, E=%u, b=%u */\n"
+                     "static const struct {\n"
+                     "    int M, N;\n"
+                     "    struct trans_param param;\n"
+                     "} trans_tuned[] = {\n", out_path, s, E, b);
+        for (int i = 0; i < nsizes; i++) {
+            const struct trans_param* p = &best[i].p;
+            fprintf(out, "    { %d, %d, { %d, %d, %d, %d, %d } }, /* %u misses */\n",
+                    sizes[i][0], sizes[i][1], p->bh, p->bw, p->order, p->diag,
+                    p->stage, best[i].misses);
+        }
+        fprintf(out, "};\n");
+        if (fclose(out) != 0) {
+            perror(out_path);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -124,9 +124,11 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_touch(trace_t *trace, int tracenum, char *touchfile);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printmmstats(void);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -149,6 +151,8 @@ int main(int argc, char **argv)
 
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int touch = 0;       /* If set, report heap accesses of mm.c (-c) */
+    char *touchfile = NULL; /* If set, write those accesses here (-T) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -157,8 +161,15 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:T:hvVgalc")) != EOF) {
         switch (c) {
+	case 'c': /* Report the cache lines and pages mm.c touches */
+	    touch = 1;
+	    break;
+	case 'T': /* ... and write every access to a trace file */
+	    touch = 1;
+	    touchfile = optarg;
+	    break;
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
 	    break;
@@ -273,6 +284,10 @@ int main(int argc, char **argv)
 	    if (verbose > 1)
 		printf("and performance.\n");
 	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+	    if (verbose > 1)
+		printmmstats();
+	    if (touch)
+		eval_mm_touch(trace, i, touchfile);
 	}
 	free_trace(trace);
     }
@@ -795,6 +810,74 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * eval_mm_touch - Run the trace once more with mem_touch recording on,
+ *    and report how many distinct cache lines and pages the mm package's
+ *    own loads and stores touch per request. This needs an mm.c built
+ *    with -DMM_TRACE (make mdriver-trace). If touchfile is set, the
+ *    accesses are also written to <touchfile>.<tracenum> in valgrind
+ *    format, ready to be replayed by a cache simulator such as csim.
+ */
+static void eval_mm_touch(trace_t *trace, int tracenum, char *touchfile)
+{
+    int i, index;
+    char *p;
+    char path[MAXLINE];
+    FILE *fp = NULL;
+    struct mem_touch_stats st;
+
+    if (touchfile) {
+	sprintf(path, "%.1000s.%d", touchfile, tracenum);
+	if ((fp = fopen(path, "w")) == NULL)
+	    unix_error("Could not open touch trace file");
+    }
+
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_touch");
+
+    mem_touch_start(fp);
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	mem_touch_op();
+        switch (trace->ops[i].type) {
+        case ALLOC: /* mm_malloc */
+            if ((p = mm_malloc(trace->ops[i].size)) == NULL)
+		app_error("mm_malloc error in eval_mm_touch");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+	    p = mm_realloc(trace->blocks[index], trace->ops[i].size);
+            if (p == NULL)
+		app_error("mm_realloc error in eval_mm_touch");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            mm_free(trace->blocks[index]);
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_touch");
+        }
+    }
+    mem_touch_stop(&st);
+    if (fp)
+	fclose(fp);
+
+    if (st.accesses == 0) {
+	printf("  touch (trace %d): no accesses recorded, "
+	       "build with make mdriver-trace\n", tracenum);
+	return;
+    }
+    printf("  touch (trace %d): %.1f accesses, %.2f lines (max %lu), "
+	   "%.2f pages (max %lu) per request\n",
+	   tracenum, (double)st.accesses / st.ops,
+	   (double)st.lines / st.ops, st.max_lines,
+	   (double)st.pages / st.ops, st.max_pages);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -942,6 +1025,40 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printmmstats - prints the mm package's own counters for the last
+ *     run of a trace (every run of a trace does the same work, so
+ *     the counters left behind by the last timing run will do)
+ */
+static void printmmstats(void)
+{
+    int i;
+    struct mm_stats st;
+
+    mm_get_stats(&st);
+    printf("  calls: %lu malloc, %lu free, %lu realloc\n",
+	   st.mallocs, st.frees, st.reallocs);
+    printf("  find_fit: %lu searches, %.1f avg / %lu max inspected, "
+	   "%lu misses\n",
+	   st.fit_searches,
+	   st.fit_searches ? (double)st.fit_inspected / st.fit_searches : 0.0,
+	   st.fit_max_inspected, st.fit_misses);
+    printf("  blocks: %lu splits, %lu coalesces, free list %lu now / %lu max\n",
+	   st.splits, st.coalesces, st.free_blocks, st.max_free_blocks);
+    printf("  bytes: %lu requested, %lu reserved (%.0f%%)\n",
+	   st.bytes_requested, st.bytes_reserved,
+	   st.bytes_reserved ? 
+	   100.0 * st.bytes_requested / st.bytes_reserved : 0.0);
+    printf("  sbrk: %lu calls, %lu bytes\n", st.sbrk_calls, st.sbrk_bytes);
+    printf("  size classes:");
+    for (i = 0; i < MM_NCLASSES; i++)
+	if (st.class_requests[i])
+	    printf(" %s%lu:%lu", i == MM_NCLASSES - 1 ? ">" : "<=",
+		   16UL << (i == MM_NCLASSES - 1 ? i - 1 : i),
+		   st.class_requests[i]);
+    printf("\n");
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -974,13 +1091,15 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValc] [-f <file>] [-t <dir>] [-T <file>]\n");
     fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-c         Count cache lines and pages mm.c touches per request.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <file>  Like -c, also write the accesses to <file>.<trace>.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
@@ -18,15 +18,42 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static int mem_guards;       /* number of pages currently guarded */
+
+/* 
+ * Touch recording (see mem_touch). Lines and pages touched by the
+ * current request are remembered in small open addressed sets; an
+ * entry belongs to the current request when its stamp matches.
+ */
+#define TOUCH_SLOTS 4096     /* per set, must be a power of 2 */
+
+typedef struct {
+    size_t addr;
+    size_t stamp;
+} touch_slot_t;
+
+static int touch_on;                       /* recording? */
+static FILE *touch_fp;                     /* optional trace output */
+static size_t touch_stamp;                 /* current request number */
+static size_t touch_pagesize;
+static size_t touch_lines, touch_pages;    /* distinct in current request */
+static touch_slot_t line_set[TOUCH_SLOTS];
+static touch_slot_t page_set[TOUCH_SLOTS];
+static struct mem_touch_stats touch_stats;
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* 
+     * allocate the storage we will use to model the available VM,
+     * page aligned so that parts of it can be protected with mem_guard
+     */
+    mem_start_brk = (char *)mmap(NULL, MAX_HEAP, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem_start_brk == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
 
@@ -39,7 +66,7 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(mem_start_brk, MAX_HEAP);
 }
 
 /*
@@ -47,6 +74,11 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
+    /* drop any guard pages a previous run left behind */
+    if (mem_guards) {
+	mprotect(mem_start_brk, MAX_HEAP, PROT_READ | PROT_WRITE);
+	mem_guards = 0;
+    }
     mem_brk = mem_start_brk;
 }
 
@@ -99,3 +131,126 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_guard - make len bytes of the heap starting at the page aligned
+ *    address addr inaccessible, so any access to them faults
+ */
+void mem_guard(void *addr, size_t len)
+{
+    if (mprotect(addr, len, PROT_NONE) < 0) {
+	fprintf(stderr, "mem_guard: mprotect error: %s\n", strerror(errno));
+	exit(1);
+    }
+    mem_guards++;
+}
+
+/*
+ * mem_unguard - undo mem_guard
+ */
+void mem_unguard(void *addr, size_t len)
+{
+    if (mprotect(addr, len, PROT_READ | PROT_WRITE) < 0) {
+	fprintf(stderr, "mem_unguard: mprotect error: %s\n", strerror(errno));
+	exit(1);
+    }
+    mem_guards--;
+}
+
+/*
+ * touch_insert - add addr to a touch set, returns 1 if it was not
+ *    already there for the current request
+ */
+static int touch_insert(touch_slot_t *set, size_t addr)
+{
+    size_t i = (addr * 0x9e3779b97f4a7c15UL) >> 52;
+    size_t n;
+
+    for (n = 0; n < TOUCH_SLOTS; n++, i = (i + 1) & (TOUCH_SLOTS - 1)) {
+	if (set[i].stamp != touch_stamp) {
+	    set[i].addr = addr;
+	    set[i].stamp = touch_stamp;
+	    return 1;
+	}
+	if (set[i].addr == addr)
+	    return 0;
+    }
+    return 1; /* set is full, count it anyway */
+}
+
+/*
+ * touch_end_op - fold the request that just finished into the totals
+ */
+static void touch_end_op(void)
+{
+    if (touch_lines == 0)
+	return;
+    touch_stats.lines += touch_lines;
+    touch_stats.pages += touch_pages;
+    if (touch_lines > touch_stats.max_lines)
+	touch_stats.max_lines = touch_lines;
+    if (touch_pages > touch_stats.max_pages)
+	touch_stats.max_pages = touch_pages;
+    touch_lines = touch_pages = 0;
+}
+
+/*
+ * mem_touch_start - start recording heap accesses reported through
+ *    mem_touch and clear the totals. If fp is not NULL, every access is
+ *    also written to it as a valgrind lackey style line, with addresses
+ *    given as offsets from the start of the heap so that traces are the
+ *    same from run to run.
+ */
+void mem_touch_start(FILE *fp)
+{
+    memset(&touch_stats, 0, sizeof(touch_stats));
+    touch_fp = fp;
+    touch_pagesize = mem_pagesize();
+    touch_lines = touch_pages = 0;
+    touch_stamp++;
+    touch_on = 1;
+}
+
+/*
+ * mem_touch_op - mark the start of the next allocator request
+ */
+void mem_touch_op(void)
+{
+    touch_end_op();
+    touch_stamp++;
+    touch_stats.ops++;
+}
+
+/*
+ * mem_touch_stop - stop recording and return the totals
+ */
+void mem_touch_stop(struct mem_touch_stats *stats)
+{
+    touch_end_op();
+    touch_on = 0;
+    touch_fp = NULL;
+    *stats = touch_stats;
+}
+
+/*
+ * mem_touch - record that the allocator read (write = 0) or wrote
+ *    len bytes of heap at addr. mm.c only calls this when it is built
+ *    with -DMM_TRACE.
+ */
+void mem_touch(const void *addr, size_t len, int write)
+{
+    size_t off = (const char *)addr - mem_start_brk;
+    size_t line, last = (off + len - 1) / MEM_LINE_SIZE;
+
+    if (!touch_on)
+	return;
+
+    touch_stats.accesses++;
+    for (line = off / MEM_LINE_SIZE; line <= last; line++)
+	touch_lines += touch_insert(line_set, line);
+    touch_pages += touch_insert(page_set, off / touch_pagesize);
+
+    if (touch_fp)
+	fprintf(touch_fp, " %c %lx,%lu\n", write ? 'S' : 'L', off, len);
+}
+
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <unistd.h>
 
 void mem_init(void);               
@@ -8,4 +9,22 @@ void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+void mem_guard(void *addr, size_t len);
+void mem_unguard(void *addr, size_t len);
 
+/* Recording of the heap accesses made by mm.c (built with -DMM_TRACE) */
+#define MEM_LINE_SIZE 64
+
+struct mem_touch_stats {
+    size_t ops;        /* requests seen */
+    size_t accesses;   /* loads and stores reported */
+    size_t lines;      /* distinct cache lines per request, summed */
+    size_t pages;      /* distinct pages per request, summed */
+    size_t max_lines;  /* most cache lines touched by one request */
+    size_t max_pages;  /* most pages touched by one request */
+};
+
+void mem_touch_start(FILE *fp);
+void mem_touch_op(void);
+void mem_touch_stop(struct mem_touch_stats *stats);
+void mem_touch(const void *addr, size_t len, int write);
@@ -0,0 +1,348 @@
+/*
+ * mm-fuzz.c - Fuzz and differential test harness for mm.c
+ *
+ * Decodes an arbitrary byte string into a stream of malloc/realloc/free
+ * requests and replays it against mm.c and libc malloc side by side.
+ * After every request the payloads are checked against a shadow model:
+ * alignment, placement inside the heap, no overlap with any other live
+ * payload, contents preserved across realloc and identical to the libc
+ * copy, and mm_checkheap() must still accept the heap. Any violation
+ * aborts, so fuzzers see it as a crash.
+ *
+ * The same source builds three ways:
+ *   make mm-fuzz            standalone; replays files named on the
+ *                           command line or stdin (AFL: mm-fuzz @@),
+ *                           or generates random streams with -n
+ *   make mm-fuzz-libfuzzer  libFuzzer target (needs clang)
+ *   make mm-fuzz MMFLAGS=-DMM_COMPACT_LINKS   fuzz another layout
+ *
+ * Input format: a sequence of 4 byte records
+ *   byte 0   bits 0-1 request (0,1 malloc, 2 free, 3 realloc)
+ *            bit 4    large request (size up to 64K instead of 256)
+ *   byte 1   slot the request applies to (mod NSLOTS)
+ *   byte 2-3 size, little endian
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+/* Misc */
+#define NSLOTS     64           /* live blocks tracked at once */
+#define LIVE_LIMIT (MAX_HEAP/4) /* cap on live payload bytes */
+#define CHECK_ALL  64           /* recheck every payload this often */
+
+/* Returns true if p is ALIGNMENT-byte aligned */
+#define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
+
+/* One live block, in both allocators */
+typedef struct {
+    char *mm;          /* payload from mm.c, NULL if the slot is empty */
+    char *libc;        /* same payload from libc malloc */
+    size_t size;       /* requested size */
+    unsigned char pat; /* byte both payloads were filled with */
+} slot_t;
+
+static slot_t slots[NSLOTS];
+static size_t live_bytes;
+static unsigned char next_pat;
+static int opnum;
+static int verbose;
+
+/*
+ * fuzz_error - report a violation and abort, so it looks like a crash
+ */
+static void fuzz_error(const char *msg, int slot)
+{
+    fprintf(stderr, "mm-fuzz: op %d, slot %d: %s\n", opnum, slot, msg);
+    mm_checkheap(1);
+    abort();
+}
+
+/*
+ * check_contents - a payload must still hold its pattern in both
+ *     allocators, over its first len bytes
+ */
+static void check_contents(int i, size_t len)
+{
+    size_t j;
+
+    for (j = 0; j < len; j++) {
+        if ((unsigned char)slots[i].libc[j] != slots[i].pat)
+            fuzz_error("libc payload changed under us", i);
+        if ((unsigned char)slots[i].mm[j] != slots[i].pat)
+            fuzz_error("payload contents differ from libc", i);
+    }
+}
+
+/*
+ * check_placement - a new payload of size bytes at p must be aligned,
+ *     inside the heap and clear of every other live payload
+ */
+static void check_placement(int i, char *p, size_t size)
+{
+    int k;
+    char *hi = p + size - 1;
+
+    if (!IS_ALIGNED(p))
+        fuzz_error("payload is not aligned", i);
+    if (p < (char *)mem_heap_lo() || hi > (char *)mem_heap_hi())
+        fuzz_error("payload lies outside the heap", i);
+
+    for (k = 0; k < NSLOTS; k++) {
+        if (k == i || !slots[k].mm)
+            continue;
+        if (p <= slots[k].mm + slots[k].size - 1 && slots[k].mm <= hi)
+            fuzz_error("payload overlaps another payload", i);
+    }
+}
+
+/*
+ * fill - give slot i a fresh pattern in both allocators
+ */
+static void fill(int i)
+{
+    slots[i].pat = next_pat++;
+    memset(slots[i].mm, slots[i].pat, slots[i].size);
+    memset(slots[i].libc, slots[i].pat, slots[i].size);
+}
+
+/*
+ * heap_full - mm.c may legitimately fail once the simulated heap is
+ *     nearly used up; anything earlier is a bug
+ */
+static int heap_full(size_t size)
+{
+    return mem_heapsize() + 2 * size + (1 << 16) > MAX_HEAP;
+}
+
+static void do_free(int i)
+{
+    if (!slots[i].mm)
+        return;
+    check_contents(i, slots[i].size);
+    mm_free(slots[i].mm);
+    free(slots[i].libc);
+    live_bytes -= slots[i].size;
+    slots[i].mm = NULL;
+}
+
+static void do_malloc(int i, size_t size)
+{
+    char *p;
+
+    do_free(i);
+    if (live_bytes + size > LIVE_LIMIT)
+        return;
+    if ((p = mm_malloc(size)) == NULL) {
+        if (heap_full(size))
+            return;
+        fuzz_error("mm_malloc failed", i);
+    }
+    check_placement(i, p, size);
+
+    slots[i].mm = p;
+    if ((slots[i].libc = malloc(size)) == NULL)
+        fuzz_error("libc malloc failed", i);
+    slots[i].size = size;
+    live_bytes += size;
+    fill(i);
+}
+
+static void do_realloc(int i, size_t size)
+{
+    char *p, *q;
+    size_t keep;
+
+    if (!slots[i].mm) {
+        do_malloc(i, size);
+        return;
+    }
+    if (live_bytes - slots[i].size + size > LIVE_LIMIT)
+        return;
+    check_contents(i, slots[i].size);
+
+    if ((p = mm_realloc(slots[i].mm, size)) == NULL) {
+        if (heap_full(size))
+            return;
+        fuzz_error("mm_realloc failed", i);
+    }
+    check_placement(i, p, size);
+    if ((q = realloc(slots[i].libc, size)) == NULL)
+        fuzz_error("libc realloc failed", i);
+
+    keep = size < slots[i].size ? size : slots[i].size;
+    live_bytes += size - slots[i].size;
+    slots[i].mm = p;
+    slots[i].libc = q;
+    slots[i].size = size;
+    check_contents(i, keep);
+    fill(i);
+}
+
+/*
+ * run_ops - replay one input against a fresh heap
+ */
+static void run_ops(const uint8_t *data, size_t len)
+{
+    static int initialized = 0;
+    size_t n;
+    int i;
+
+    if (!initialized) {
+        mem_init();
+        initialized = 1;
+    }
+    mem_reset_brk();
+    if (mm_init() < 0)
+        fuzz_error("mm_init failed", -1);
+    memset(slots, 0, sizeof(slots));
+    live_bytes = 0;
+
+    for (opnum = 0, n = 0; n + 4 <= len; n += 4, opnum++) {
+        int slot = data[n + 1] % NSLOTS;
+        size_t raw = data[n + 2] | (data[n + 3] << 8);
+        size_t size = 1 + raw % ((data[n] & 0x10) ? 65536 : 256);
+
+        switch (data[n] & 0x3) {
+        case 0:
+        case 1:
+            do_malloc(slot, size);
+            break;
+        case 2:
+            do_free(slot);
+            break;
+        case 3:
+            do_realloc(slot, size);
+            break;
+        }
+
+        if (mm_checkheap(verbose) < 0)
+            fuzz_error("mm_checkheap found an inconsistent heap", slot);
+        if (opnum % CHECK_ALL == 0)
+            for (i = 0; i < NSLOTS; i++)
+                if (slots[i].mm)
+                    check_contents(i, slots[i].size);
+    }
+
+    for (i = 0; i < NSLOTS; i++)
+        do_free(i);
+    if (mm_checkheap(verbose) < 0)
+        fuzz_error("mm_checkheap found an inconsistent heap", -1);
+}
+
+/*
+ * LLVMFuzzerTestOneInput - libFuzzer entry point
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    run_ops(data, size);
+    return 0;
+}
+
+#ifndef MM_FUZZ_LIBFUZZER
+
+/*
+ * read_input - slurp a whole file into memory
+ */
+static uint8_t *read_input(FILE *f, size_t *len)
+{
+    size_t cap = 4096, n;
+    uint8_t *buf = malloc(cap);
+
+    *len = 0;
+    while (buf && (n = fread(buf + *len, 1, cap - *len, f)) > 0) {
+        *len += n;
+        if (*len == cap)
+            buf = realloc(buf, cap *= 2);
+    }
+    if (buf == NULL) {
+        fprintf(stderr, "mm-fuzz: out of memory reading input\n");
+        exit(1);
+    }
+    return buf;
+}
+
+static void run_file(const char *path)
+{
+    FILE *f = path ? fopen(path, "rb") : stdin;
+    uint8_t *buf;
+    size_t len;
+
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    buf = read_input(f, &len);
+    if (path)
+        fclose(f);
+    if (verbose)
+        printf("%s: %lu ops\n", path ? path : "stdin", len / 4);
+    run_ops(buf, len);
+    free(buf);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mm-fuzz [-hv] [-n <runs>] [-s <seed>] [file ...]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-n <runs>  Replay <runs> random streams instead of files.\n");
+    fprintf(stderr, "\t-s <seed>  Seed for -n (default 1).\n");
+    fprintf(stderr, "\t-v         Report heap checker failures in detail.\n");
+    fprintf(stderr, "With no files and no -n, one stream is read from stdin.\n");
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, runs = 0;
+    unsigned seed = 1;
+
+    while ((c = getopt(argc, argv, "hvn:s:")) != -1) {
+        switch (c) {
+        case 'n':
+            runs = atoi(optarg);
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    if (runs > 0) {
+        srand(seed);
+        for (i = 0; i < runs; i++) {
+            size_t j, len = 4 * (1 + rand() % 4096);
+            uint8_t *buf = malloc(len);
+            for (j = 0; j < len; j++)
+                buf[j] = rand();
+            run_ops(buf, len);
+            free(buf);
+        }
+        printf("mm-fuzz: %d random streams passed (seed %u)\n", runs, seed);
+    }
+    else if (optind == argc) {
+        run_file(NULL);
+    }
+    else {
+        for (i = optind; i < argc; i++)
+            run_file(argv[i]);
+    }
+    return 0;
+}
+
+#endif /* MM_FUZZ_LIBFUZZER */
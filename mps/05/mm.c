@@ -6,6 +6,7 @@
 #include <string.h>
 #include <assert.h>
 #include <unistd.h>
+#include <stdint.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -19,11 +20,49 @@
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
+#ifdef MM_TRACE
+// report every metadata access to memlib (make mdriver-trace)
+#define TOUCH(p, w)  (mem_touch((p), sizeof(*(p)), (w)), (p))
+#else
+#define TOUCH(p, w)  (p)
+#endif
+
+// all header, footer and link accesses go through these
+#define LOAD(x)       (*TOUCH(&(x), 0))
+#define STORE(x, val) (*TOUCH(&(x), 1) = (val))
+
 // access bitmap on size_t header
-#define GET(p)       (*(size_t *)(p))
-#define GET_SIZE(p)  (GET(p) & ~1L)
+#define GET(p)       LOAD(*(size_t *)(p))
+#define PUT(p, val)  STORE(*(size_t *)(p), (val))
+#define GET_SIZE(p)  (GET(p) & ~0x7L)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 
+#ifdef MM_COMPACT_LINKS
+
+/*
+ * The simulated heap is never bigger than MAX_HEAP, so free list links
+ * can be 32-bit offsets from the start of the heap instead of pointers.
+ * That takes the minimum block from 32 down to 24 bytes.
+ */
+struct free_blk_head {
+	size_t size;
+	uint32_t next;
+	uint32_t prev;
+};
+
+// start of the heap, offsets are relative to it
+static char* heap_base;
+
+#define BLK_PTR(off) ((struct free_blk_head*) (heap_base + (off)))
+#define BLK_OFF(p)   ((uint32_t) ((char*) (p) - heap_base))
+
+#define NEXT(h)        BLK_PTR(LOAD((h)->next))
+#define PREV(h)        BLK_PTR(LOAD((h)->prev))
+#define SET_NEXT(h, p) STORE((h)->next, BLK_OFF(p))
+#define SET_PREV(h, p) STORE((h)->prev, BLK_OFF(p))
+
+#else
+
 // ll to track free spaces
 struct free_blk_head {
 	size_t size;
@@ -31,33 +70,109 @@ struct free_blk_head {
     struct free_blk_head* prev;
 };
 
+#define NEXT(h)        LOAD((h)->next)
+#define PREV(h)        LOAD((h)->prev)
+#define SET_NEXT(h, p) STORE((h)->next, (p))
+#define SET_PREV(h, p) STORE((h)->prev, (p))
 
+#endif
 
 struct free_blk_head* free_list_head;
 void* first_block_addr;
 
 #define MIN_BLOCK_SIZE (ALIGN(sizeof(struct free_blk_head)) + SIZE_T_SIZE)
 
+#ifdef MM_GUARD_PAGES
+#ifndef MM_DEBUG
+#define MM_DEBUG
+#endif
+#endif
+
+#ifdef MM_DEBUG
+/*
+ * Debug layout (make mdriver-debug): the payload is preceded by the
+ * requested size and a canary word and followed directly by a second,
+ * unaligned canary. Both are checked on free. Free blocks are poisoned
+ * past their list links and checked again when they are handed out,
+ * which catches writes through stale pointers.
+ *
+ *   | header | size | canary | payload ... | canary | ... | footer |
+ *
+ * With MM_GUARD_PAGES, payloads of at least GUARD_MIN_SIZE bytes are
+ * placed so they end on a page boundary and the page after them is
+ * made inaccessible, so an overrun faults on the offending store.
+ *
+ *   | header | size | canary | payload ... | guard page | footer |
+ */
+#define DEBUG_HEAD     (2 * SIZE_T_SIZE)
+#define DEBUG_TAIL     SIZE_T_SIZE
+#define CANARY         0xdeadbeefcafef00dUL
+#define POISON         0xdb
+#define GUARDED        0x2  // header flag: block ends in a guard page
+#define GUARD_MIN_SIZE 4096
+#else
+#define DEBUG_HEAD     0
+#define DEBUG_TAIL     0
+#endif
+
+// distance from a block header to its payload
+#define PAYLOAD_OFFSET (SIZE_T_SIZE + DEBUG_HEAD)
+
+// counters reported through mm_get_stats()
+static struct mm_stats stats;
+
+// free list grew/shrank by one block
+#define STAT_FREE_INC() do { \
+        if (++stats.free_blocks > stats.max_free_blocks) \
+            stats.max_free_blocks = stats.free_blocks; \
+    } while (0)
+#define STAT_FREE_DEC() (stats.free_blocks--)
+
+// size class of a request, see mm.h
+static int size_class(size_t size) {
+	int c = 0;
+	if (size <= 16)
+		return 0;
+	size = (size - 1) >> 4;
+	while (size && c < MM_NCLASSES - 1) {
+		size >>= 1;
+		c++;
+	}
+	return c;
+}
+
 // look for free space
 void* find_fit(size_t size) {
-	struct free_blk_head* block = free_list_head->next;
+	struct free_blk_head* block = NEXT(free_list_head);
+	size_t inspected = 0;
+	void* ret = NULL;
 
 	while (block != free_list_head) {
-		if (block->size >= size)
-			return block;
-		block = block->next;
+		inspected++;
+		if (GET(block) >= size) {
+			ret = block;
+			break;
+		}
+		block = NEXT(block);
 	}
-	return NULL;
+
+	stats.fit_searches++;
+	stats.fit_inspected += inspected;
+	if (inspected > stats.fit_max_inspected)
+		stats.fit_max_inspected = inspected;
+	if (!ret)
+		stats.fit_misses++;
+	return ret;
 }
 
-// unify adjacent free spaces
-void coalesce(struct free_blk_head* header) {
-	size_t* footer = (size_t*) ((char*) header + header->size - SIZE_T_SIZE);
+// unify adjacent free spaces, returns the resulting free block
+struct free_blk_head* coalesce(struct free_blk_head* header) {
+	size_t* footer = (size_t*) ((char*) header + GET(header) - SIZE_T_SIZE);
 
 	int next_alloc = 1, prev_alloc = 1;
 	size_t* prev_footer = (size_t*) ((char*) header - SIZE_T_SIZE);
 	struct free_blk_head* prev_header = (struct free_blk_head*) ((char*) header - GET_SIZE(prev_footer));
-	struct free_blk_head* next_header = (struct free_blk_head*) ((char*) header + header->size);
+	struct free_blk_head* next_header = (struct free_blk_head*) ((char*) header + GET(header));
 
 	if ((void*) prev_footer > first_block_addr)
 		prev_alloc = GET_ALLOC(prev_footer);
@@ -66,45 +181,216 @@ void coalesce(struct free_blk_head* header) {
 		next_alloc = GET_ALLOC(next_header);
 
 	if (prev_alloc && next_alloc) {
-		free_list_head->next->prev = header;
-		free_list_head->next = header;
+		SET_PREV(NEXT(free_list_head), header);
+		SET_NEXT(free_list_head, header);
+		STAT_FREE_INC();
 
-		*footer = *footer & ~1L;
+		PUT(footer, GET(footer) & ~1L);
 
 	} else if (!prev_alloc && next_alloc) {
 
-		size_t newsize = prev_header->size + header->size;
-		prev_header->size = newsize;
+		size_t newsize = GET(prev_header) + GET(header);
+		PUT(prev_header, newsize);
+		stats.coalesces++;
 
-		*footer = newsize;
+		PUT(footer, newsize);
 
 	} else if (prev_alloc && !next_alloc) {
 
-		size_t newsize = header->size + next_header->size;
-		header->size = newsize;
+		size_t newsize = GET(header) + GET(next_header);
+		PUT(header, newsize);
+		stats.coalesces++;
 
-		next_header->prev->next = header;
-		next_header->next->prev = header;
-		header->next = next_header->next;
-		header->prev = next_header->prev;
+		SET_NEXT(PREV(next_header), header);
+		SET_PREV(NEXT(next_header), header);
+		SET_NEXT(header, NEXT(next_header));
+		SET_PREV(header, PREV(next_header));
 
-		footer = (size_t*) ((char*) footer + next_header->size);
-		*footer = newsize;
+		footer = (size_t*) ((char*) footer + GET(next_header));
+		PUT(footer, newsize);
 
 	} else {
 
-		size_t newsize = prev_header->size + header->size + next_header->size;
-		prev_header->size = newsize;
+		size_t newsize = GET(prev_header) + GET(header) + GET(next_header);
+		PUT(prev_header, newsize);
 
 		// remove node
-		next_header->next->prev = next_header->prev;
-		next_header->prev->next = next_header->next;
+		SET_PREV(NEXT(next_header), PREV(next_header));
+		SET_NEXT(PREV(next_header), NEXT(next_header));
+		STAT_FREE_DEC();
+		stats.coalesces += 2;
 
-		footer = (size_t*) ((char*) footer + next_header->size);
-		*footer = newsize;
+		footer = (size_t*) ((char*) footer + GET(next_header));
+		PUT(footer, newsize);
 
 	}
+
+	return prev_alloc ? header : prev_header;
+}
+
+// put an allocated block back on the free list
+static void release_block(struct free_blk_head* header)
+{
+    PUT(header, GET_SIZE(header));
+    SET_NEXT(header, NEXT(free_list_head));
+    SET_PREV(header, free_list_head);
+
+#ifdef MM_DEBUG
+    header = coalesce(header);
+    memset((char*) header + sizeof(*header), POISON,
+           GET(header) - sizeof(*header) - SIZE_T_SIZE);
+#else
+    coalesce(header);
+#endif
+}
+
+#ifdef MM_DEBUG
+
+static void heap_error(const char* msg, void* block)
+{
+    fprintf(stderr, "mm: %s (block %p, payload %p)\n",
+            msg, block, (char*) block + PAYLOAD_OFFSET);
+    abort();
+}
+
+// stamp the canaries around a freshly allocated payload
+static void debug_arm(size_t* block, size_t size)
+{
+    size_t canary = CANARY;
+    block[1] = size;
+    block[2] = CANARY;
+    memcpy((char*) block + PAYLOAD_OFFSET + size, &canary, sizeof(canary));
+}
+
+// verify the canaries of a payload that is about to be freed
+static void debug_check(size_t* block)
+{
+    size_t canary;
+    char* end = (char*) block + PAYLOAD_OFFSET + block[1];
+
+    if (!GET_ALLOC(block))
+        heap_error("free of a block that is not allocated", block);
+    if (block[2] != CANARY)
+        heap_error("payload underrun", block);
+
+#ifdef MM_GUARD_PAGES
+    if (GET(block) & GUARDED) {
+        // slack up to the guard page holds canary bytes
+        for (; (uintptr_t) end % ALIGNMENT; end++)
+            if (*(unsigned char*) end != (CANARY & 0xff))
+                heap_error("payload overrun", block);
+        mem_unguard(end, mem_pagesize());
+        return;
+    }
+#endif
+
+    memcpy(&canary, end, sizeof(canary));
+    if (canary != CANARY)
+        heap_error("payload overrun", block);
+}
+
+// verify a free block's poison before it is reused
+static void debug_check_poison(struct free_blk_head* h)
+{
+    unsigned char* p = (unsigned char*) h + sizeof(*h);
+    unsigned char* end = (unsigned char*) h + GET(h) - SIZE_T_SIZE;
+
+    for (; p < end; p++)
+        if (*p != POISON)
+            heap_error("write to a freed block", h);
+}
+
+#endif
+
+#ifdef MM_GUARD_PAGES
+/*
+ * guard_pad - bytes to skip from start so that a block of body bytes
+ *     (header through payload) ends on a page boundary, leaving either
+ *     no gap or one big enough to become a free block of its own
+ */
+static size_t guard_pad(char* start, size_t body, size_t page)
+{
+    uintptr_t end = ((uintptr_t) start + body + page - 1) & ~(page - 1);
+    size_t pad = end - body - (uintptr_t) start;
+
+    while (pad != 0 && pad < MIN_BLOCK_SIZE)
+        pad += page;
+    return pad;
+}
+
+/*
+ * guarded_malloc - carve out a block whose payload ends on a page
+ *     boundary, followed by a guard page and then the footer. The
+ *     block comes from the first free block with room for it, or
+ *     else from growing the heap. Whatever is left over in front of
+ *     or behind it goes back on the free list.
+ */
+static void* guarded_malloc(size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t body = PAYLOAD_OFFSET + ALIGN(size);
+    size_t need = body + page + SIZE_T_SIZE;
+    size_t pad = 0, rest = 0, new_size = need;
+    char* start = NULL;
+    size_t* block;
+    struct free_blk_head* h;
+
+    for (h = NEXT(free_list_head); h != free_list_head; h = NEXT(h)) {
+        pad = guard_pad((char*) h, body, page);
+        if (GET(h) >= pad + need) {
+            debug_check_poison(h);
+            SET_PREV(NEXT(h), PREV(h));
+            SET_NEXT(PREV(h), NEXT(h));
+            STAT_FREE_DEC();
+
+            // a tail too small to stand alone stays with the block
+            start = (char*) h;
+            rest = GET(h) - pad - need;
+            if (rest < MIN_BLOCK_SIZE) {
+                new_size += rest;
+                rest = 0;
+            }
+            break;
+        }
+    }
+
+    if (!start) {
+        start = (char*) mem_heap_hi() + 1;
+        pad = guard_pad(start, body, page);
+        if (mem_sbrk(pad + need) == (void*) -1)
+            return NULL;
+        stats.sbrk_calls++;
+        stats.sbrk_bytes += pad + need;
+    }
+    stats.bytes_reserved += new_size;
+
+    block = (size_t*) (start + pad);
+    PUT(block, new_size | GUARDED | 1);
+    PUT((char*) block + new_size - SIZE_T_SIZE, new_size | 1);
+
+    // block is marked allocated, so the leftovers can't coalesce into it
+    if (pad) {
+        h = (struct free_blk_head*) start;
+        PUT(h, pad | 1);
+        PUT(start + pad - SIZE_T_SIZE, pad | 1);
+        release_block(h);
+    }
+    if (rest) {
+        h = (struct free_blk_head*) ((char*) block + new_size);
+        PUT(h, rest | 1);
+        PUT((char*) h + rest - SIZE_T_SIZE, rest | 1);
+        release_block(h);
+    }
+
+    block[1] = size;
+    block[2] = CANARY;
+    memset((char*) block + PAYLOAD_OFFSET + size, CANARY & 0xff,
+           ALIGN(size) - size);
+    mem_guard((char*) block + body, page);
+
+    return (char*) block + PAYLOAD_OFFSET;
 }
+#endif
 
 
 /*
@@ -117,14 +403,22 @@ int mm_init(void)
     if (free_list_head == (void*) -1)
         return -1;
 
+#ifdef MM_COMPACT_LINKS
+    heap_base = mem_heap_lo();
+#endif
+
     // init head
-    free_list_head->size = 0;
-    free_list_head->next = free_list_head;
-    free_list_head->prev = free_list_head;
+    PUT(free_list_head, 0);
+    SET_NEXT(free_list_head, free_list_head);
+    SET_PREV(free_list_head, free_list_head);
 
     // first block after free space
     first_block_addr = (char*) free_list_head + size;
 
+    memset(&stats, 0, sizeof(stats));
+    stats.sbrk_calls = 1;
+    stats.sbrk_bytes = size;
+
     return 0;
 }
 
@@ -135,9 +429,18 @@ int mm_init(void)
 void *mm_malloc(size_t size)
 {
 
-	size_t new_size = ALIGN(size + SIZE_T_SIZE * 2);
+	size_t new_size = ALIGN(size + SIZE_T_SIZE * 2 + DEBUG_HEAD + DEBUG_TAIL);
 	new_size = new_size > MIN_BLOCK_SIZE ? new_size : MIN_BLOCK_SIZE;
 
+	stats.mallocs++;
+	stats.class_requests[size_class(size)]++;
+	stats.bytes_requested += size;
+
+#ifdef MM_GUARD_PAGES
+	if (size >= GUARD_MIN_SIZE)
+		return guarded_malloc(size);
+#endif
+
 	size_t* free_block = find_fit(new_size);
 
     if (!free_block) {
@@ -149,37 +452,51 @@ void *mm_malloc(size_t size)
         // no free space found, need to grow heap
         if ((free_block = mem_sbrk(new_size)) == (void*) -1)
             return NULL;
+        stats.sbrk_calls++;
+        stats.sbrk_bytes += new_size;
     } else {
 
         struct free_blk_head* h = (struct free_blk_head*) free_block;
 
-        if (h->size >= new_size + MIN_BLOCK_SIZE) {
+#ifdef MM_DEBUG
+        debug_check_poison(h);
+#endif
+
+        if (GET(h) >= new_size + MIN_BLOCK_SIZE) {
             // split block
 
             struct free_blk_head* new_head = (struct free_blk_head*) ((char*) h + new_size);
-            new_head->size = h->size - new_size;
-            new_head->next = h->next;
-            new_head->prev = h->prev;
+            PUT(new_head, GET(h) - new_size);
+            SET_NEXT(new_head, NEXT(h));
+            SET_PREV(new_head, PREV(h));
 
-            size_t* footer = (size_t*) ((char*) h + h->size - SIZE_T_SIZE);
-            *footer = new_head->size;
+            size_t* footer = (size_t*) ((char*) h + GET(h) - SIZE_T_SIZE);
+            PUT(footer, GET(new_head));
 
             // update ll
-            h->next->prev = new_head;
-            h->prev->next = new_head;
+            SET_PREV(NEXT(h), new_head);
+            SET_NEXT(PREV(h), new_head);
+            stats.splits++;
         } else {
 
-            new_size = h->size;
-            h->next->prev = h->prev;
-            h->prev->next = h->next;
+            new_size = GET(h);
+            SET_PREV(NEXT(h), PREV(h));
+            SET_NEXT(PREV(h), NEXT(h));
+            STAT_FREE_DEC();
         }
     }
 
-	*free_block = new_size | 1;
+    stats.bytes_reserved += new_size;
+
+	PUT(free_block, new_size | 1);
 	size_t* footer = (size_t*) ((char*) free_block + new_size - SIZE_T_SIZE);
-	*footer = new_size | 1;
+	PUT(footer, new_size | 1);
 
-	return (char *) free_block + SIZE_T_SIZE;
+#ifdef MM_DEBUG
+	debug_arm(free_block, size);
+#endif
+
+	return (char *) free_block + PAYLOAD_OFFSET;
 }
 
 /*
@@ -187,12 +504,14 @@ void *mm_malloc(size_t size)
  */
 void mm_free(void *ptr)
 {
-    struct free_blk_head* header = (struct free_blk_head*) ((char*) ptr - SIZE_T_SIZE);
-    header->size = GET_SIZE(header);
-    header->next = free_list_head->next;
-    header->prev = free_list_head;
+    struct free_blk_head* header = (struct free_blk_head*) ((char*) ptr - PAYLOAD_OFFSET);
+    stats.frees++;
 
-    coalesce(header);
+#ifdef MM_DEBUG
+    debug_check((size_t*) header);
+#endif
+
+    release_block(header);
 }
 
 /*
@@ -203,12 +522,90 @@ void *mm_realloc(void *ptr, size_t size)
     if (ptr == NULL)
         return NULL;
 
+    stats.reallocs++;
     void* ret = mm_malloc(size);
 
-    size_t len = *(size_t*)((char*)ptr - SIZE_T_SIZE);
+#ifdef MM_DEBUG
+    // requested size of the old payload
+    size_t len = GET((char*)ptr - 2 * SIZE_T_SIZE);
+#else
+    size_t len = GET((char*)ptr - SIZE_T_SIZE);
+#endif
 	if (size < len)
 		len = size;
     memcpy(ret, ptr, len);
     mm_free(ptr);
     return ret;
 }
+
+/*
+ * mm_get_stats - copy out the counters collected since the last mm_init
+ */
+void mm_get_stats(struct mm_stats *ret)
+{
+    *ret = stats;
+}
+
+/*
+ * mm_checkheap - walk the heap and the free list and check that they
+ *     agree with each other. Returns 0 if the heap is consistent,
+ *     otherwise -1 after printing what is wrong when verbose is set.
+ */
+int mm_checkheap(int verbose)
+{
+    char* lo = first_block_addr;
+    char* hi = (char*) mem_heap_hi() + 1;
+    char* b;
+    struct free_blk_head* h;
+    size_t nfree = 0, nlisted = 0;
+    int prev_free = 0;
+
+#define HEAP_BAD(...) do { \
+        if (verbose) { \
+            fprintf(stderr, "mm_checkheap: "); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+        } \
+        return -1; \
+    } while (0)
+
+    for (b = lo; b < hi; b += GET_SIZE(b)) {
+        size_t size = GET_SIZE(b);
+        size_t* footer = (size_t*) (b + size - SIZE_T_SIZE);
+
+        if (size < MIN_BLOCK_SIZE || size % ALIGNMENT || b + size > hi)
+            HEAP_BAD("block %p has bad size %lu", b, size);
+        if (GET_SIZE(footer) != size || GET_ALLOC(footer) != GET_ALLOC(b))
+            HEAP_BAD("block %p header %lx does not match footer %lx",
+                     b, GET(b), GET(footer));
+        if (!GET_ALLOC(b)) {
+            if (prev_free)
+                HEAP_BAD("free block %p was not coalesced", b);
+            nfree++;
+        }
+        prev_free = !GET_ALLOC(b);
+    }
+    if (b != hi)
+        HEAP_BAD("last block overruns the heap by %ld bytes", b - hi);
+
+    for (h = NEXT(free_list_head); h != free_list_head; h = NEXT(h)) {
+        if ((char*) h < lo || (char*) h >= hi)
+            HEAP_BAD("free list node %p outside the heap", h);
+        if (GET_ALLOC(h))
+            HEAP_BAD("free list node %p is allocated", h);
+        if (NEXT(PREV(h)) != h)
+            HEAP_BAD("free list node %p has a broken prev link", h);
+        if (++nlisted > nfree)
+            HEAP_BAD("free list is longer than the %lu free blocks", nfree);
+    }
+    if (nlisted != nfree)
+        HEAP_BAD("%lu free blocks but only %lu on the free list",
+                 nfree, nlisted);
+    if (nfree != stats.free_blocks)
+        HEAP_BAD("%lu free blocks but stats say %lu",
+                 nfree, stats.free_blocks);
+
+#undef HEAP_BAD
+    return 0;
+}
+
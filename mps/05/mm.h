@@ -4,3 +4,39 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+extern int mm_checkheap(int verbose);
+
+/*
+ * Allocator statistics. Counters are reset by mm_init() and bumped
+ * inline by the allocator, so they describe everything since the
+ * last init. Request size class i holds sizes in (2^(i+3), 2^(i+4)],
+ * with class 0 also taking everything <= 16 bytes and the last class
+ * everything larger.
+ */
+#define MM_NCLASSES 16
+
+struct mm_stats {
+    size_t mallocs;          /* mm_malloc calls (including from realloc) */
+    size_t frees;            /* mm_free calls (including from realloc) */
+    size_t reallocs;         /* mm_realloc calls */
+    size_t class_requests[MM_NCLASSES]; /* mm_malloc calls per size class */
+
+    size_t fit_searches;     /* calls to find_fit */
+    size_t fit_misses;       /* find_fit found nothing, heap was grown */
+    size_t fit_inspected;    /* free blocks looked at over all searches */
+    size_t fit_max_inspected;/* longest single search */
+
+    size_t splits;           /* free blocks split on allocation */
+    size_t coalesces;        /* neighbouring free blocks merged on free */
+
+    size_t free_blocks;      /* current length of the free list */
+    size_t max_free_blocks;  /* longest the free list has been */
+
+    size_t bytes_requested;  /* payload bytes asked for */
+    size_t bytes_reserved;   /* block bytes handed out to satisfy them */
+
+    size_t sbrk_calls;       /* heap growth events */
+    size_t sbrk_bytes;       /* bytes the heap grew by */
+};
+
+extern void mm_get_stats(struct mm_stats *stats);